@@ -36,6 +36,13 @@ done
 
 output=${input%.*}.png
 
+# binary trajectories written by the simulator are converted to text first
+if [[ "$input" == *.trj ]]; then
+  converter=$(dirname "$0")/../src/trajectory_converter/bin/trajectory_converter.exe
+  "$converter" --input "$input" --output "${input%.*}.txt" || exit
+  input=${input%.*}.txt
+fi
+
 function setup_plotter_with_inset()
 {
   > plotter.gnu
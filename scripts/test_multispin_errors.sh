@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# Checks that the multispin engine reports non-zero standard errors of the
+# averaged density when the repetition count is not a multiple of the 64
+# replicas of a block (the last block is short). Exits non-zero on failure.
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+simulator=$root/src/simulator/bin/simulator.exe
+network=$root/networks/network__S_9__b_2__M0_2.txt
+output=$(mktemp -d)
+trap 'rm -rf "$output"' EXIT
+
+status=0
+for repetitions in 70 100 128
+do
+  "$simulator" --network "$network" --lambda 3 --model A --engine multispin --repetitions $repetitions \
+    --min_time 1 --max_time 100 --points_per_decade 5 --seed 1 --output "$output" > /dev/null || exit 1
+  zeros=$(awk '$3 <= 0 { n++ } END { print n + 0 }' "$output/result_3_final.txt")
+  rows=$(wc -l < "$output/result_3_final.txt")
+  if [ "$rows" -eq 0 ] || [ "$zeros" -ne 0 ]; then
+    echo "repetitions = $repetitions: $zeros of $rows bins without a standard error"
+    status=1
+  else
+    echo "repetitions = $repetitions: ok"
+  fi
+done
+exit $status
@@ -1,144 +1,237 @@
-#include <fstream>
-#include <vector>
-#include <string>
-#include <algorithm>
-#include <iostream>
-#include <regex>
-
-#include <boost/program_options.hpp>
-
-namespace po = boost::program_options;
-
-std::vector<std::string> split(const std::string& input, const std::string& regex)
-{
-	// passing -1 as the submatch index parameter performs splitting
-	std::regex re(regex);
-	std::sregex_token_iterator
-		 first{input.begin(), input.end(), re, -1},
-		 last;
-	return {first, last};
-}
-
-int main(int argc, char **argv)
-{
-	std::string input_file_name;
-	long double epsilon;
-	std::string output_file_name;
-	std::size_t column;
-	std::size_t start_row;
-	po::options_description desc("Program options");
-	desc.add_options()("help", "Produce help message")(
-		"input", po::value<std::string>(&input_file_name)->required(), "Input file name.")(
-		"column", po::value<std::size_t>(&column)->default_value(1), "Column number in input file (1-based).")(
-		"start_row", po::value<std::size_t>(&start_row)->default_value(1), "Start row in input file (1-based).")(
-		"output", po::value<std::string>(&output_file_name)->required(), "Output file name.");
-
-	po::variables_map vm;
-	try
-	{
-		po::store(po::parse_command_line(argc, argv, desc), vm);
-		po::notify(vm);
-	}
-	catch (po::error &e)
-	{
-		std::cerr << "\nError parsing command line: " << e.what() << std::endl
-					 << std::endl;
-		std::cerr << desc << std::endl;
-		return false;
-	}
-
-	if (vm.count("help"))
-	{
-		std::cout << desc << std::endl;
-		return 1;
-	}
-
-	std::ifstream in(input_file_name);
-	if (!in.is_open())
-	{
-		std::cerr << "Cannot open input file." << std::endl;
-		return -1;
-	}
-	std::vector<long double> values;
-	std::string line;
-	std::size_t lines_read = 0;
-	while (std::getline(in, line))
-	{
-		const std::vector<std::string>& tokens = split(line, "\\s");
-		if(tokens.size() >= column)
-		{
-			if(++lines_read > start_row)
-			{
-				long double val = std::stold(tokens[column-1]);
-				values.push_back(val);
-			}
-		}
-		else
-		{
-			std::cerr << "Invalid input data: one of the lines does not contain enough columns." << std::endl;
-			in.close();
-			return -1;
-		}
-	}
-	in.close();
-	if(values.empty())
-	{
-		return -1;
-	}
-
-	std::size_t n = values.size();
-
-	// first calculate mean value and if it's != 0, subtract from input data
-	long double mean = .0;
-	for(const long double& val : values)
-	{
-		mean += val;
-	}
-	mean /= n;
-	if(mean > std::numeric_limits<long double>::epsilon())
-	{
-		for(long double& val : values)
-		{
-			val -= mean;
-		}
-	}
-
-	// calcute dispersion of input data
-	long double dispersion = .0;
-	for(const long double& val : values)
-	{
-		dispersion += val*val;
-	}
-	dispersion /= n;
-
-	std::vector<long double> autocorrelation_f(n, .0);
-
-	// for each fixed value of time period calculate auto-correlation
-	// maximum value for time period is the length of input data
-	for(std::size_t t = 0; t < n; ++t)
-	{
-		// now consider all pairs of input data having distance equal to t
-		// we need a window of size t, which we'll slide through our data and collect mentioned pairs
-		long double autocorrelation = .0;
-		long double factor = 1.0 / ((n-t)*dispersion);
-		for(std::size_t i = 0; i < n - t; ++i)
-		{
-			autocorrelation += values[i]*values[i+t];
-		}
-		autocorrelation *= factor;
-		autocorrelation_f[t] = autocorrelation;
-	}
-
-	std::ofstream out(output_file_name);
-	if (!out.is_open())
-	{
-		std::cerr << "Invalid output file." << std::endl;
-		return -1;
-	}
-	for(std::size_t i = 0; i < n; ++i)
-	{
-		out << i << " " << autocorrelation_f[i] << '\n';
-	}
-	out.close();
-	return 0;
-}
\ No newline at end of file
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <set>
+#include <utility>
+
+#include <boost/program_options.hpp>
+
+#include "autocorrelation.hpp"
+#include "column_reader.hpp"
+#include "input_files.hpp"
+
+namespace po = boost::program_options;
+
+// Files of a batch whose autocorrelations are held at once before they are added
+// up in file order, which keeps the averages independent of the thread count.
+const std::size_t batch_block_size = 64;
+
+// Autocorrelation of the series for lags 0..max_lag-1, normalized by the variance;
+// max_lag 0 or beyond the series length means all lags.
+std::vector<long double> normalized_autocorrelation(std::vector<long double> values, std::size_t max_lag, const std::string &method)
+{
+	std::size_t n = values.size();
+	if(0 == max_lag || max_lag > n)
+	{
+		max_lag = n;
+	}
+
+	// first calculate mean value and subtract it from input data
+	long double mean = .0;
+	for(const long double& val : values)
+	{
+		mean += val;
+	}
+	mean /= n;
+	for(long double& val : values)
+	{
+		val -= mean;
+	}
+
+	// calcute dispersion of input data
+	long double dispersion = .0;
+	for(const long double& val : values)
+	{
+		dispersion += val*val;
+	}
+	dispersion /= n;
+
+	// for each fixed value of time period calculate auto-correlation
+	// maximum value for time period is the length of input data
+	bool use_fft = "fft" == method || ("auto" == method && autocorrelation_prefers_fft(n, max_lag));
+	std::vector<long double> autocorrelation_f = use_fft ? autocorrelation_fft(values, max_lag) : autocorrelation_direct(values, max_lag);
+	for(std::size_t t = 0; t < max_lag; ++t)
+	{
+		autocorrelation_f[t] /= (n-t)*dispersion;
+	}
+	return autocorrelation_f;
+}
+
+bool write_autocorrelation(const std::string &file_name, const std::vector<long double> &autocorrelation_f)
+{
+	std::ofstream out(file_name);
+	if (!out.is_open())
+	{
+		return false;
+	}
+	for(std::size_t i = 0; i < autocorrelation_f.size(); ++i)
+	{
+		out << i << " " << autocorrelation_f[i] << '\n';
+	}
+	out.close();
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<std::string> inputs;
+	std::string output_file_name;
+	std::string per_file_folder;
+	std::size_t column;
+	std::size_t start_row;
+	std::size_t max_lag;
+	std::string method;
+	po::options_description desc("Program options");
+	desc.add_options()("help", "Produce help message")(
+		"input", po::value<std::vector<std::string> >(&inputs)->required()->multitoken(), "Input file names, glob patterns or @list files with one name or pattern per line. Several files are processed concurrently and averaged.")(
+		"column", po::value<std::size_t>(&column)->default_value(1), "Column number in input file (1-based).")(
+		"start_row", po::value<std::size_t>(&start_row)->default_value(1), "Start row in input file (1-based).")(
+		"max_lag", po::value<std::size_t>(&max_lag)->default_value(0), "Number of lags to compute (0 - all lags up to the series length).")(
+		"method", po::value<std::string>(&method)->default_value("auto"), "Autocorrelation kernel: 'fft', 'direct' or 'auto' - the faster one for the given length and lag count.")(
+		"per_file_output", po::value<std::string>(&per_file_folder), "Folder for the autocorrelation of every input file, written to <input name>_autocorrelation.txt.")(
+		"output", po::value<std::string>(&output_file_name)->required(), "Output file name. With several input files: the mean autocorrelation over the files and its standard error, for the lags all files have.");
+
+	po::variables_map vm;
+	try
+	{
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+	}
+	catch (po::error &e)
+	{
+		std::cerr << "\nError parsing command line: " << e.what() << std::endl
+					 << std::endl;
+		std::cerr << desc << std::endl;
+		return false;
+	}
+
+	if (vm.count("help"))
+	{
+		std::cout << desc << std::endl;
+		return 1;
+	}
+
+	if(method != "auto" && method != "fft" && method != "direct")
+	{
+		std::cerr << "Invalid method." << std::endl;
+		return -1;
+	}
+
+	std::vector<std::string> input_file_names;
+	try
+	{
+		input_file_names = expand_input_files(inputs);
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+	const bool per_file = vm.count("per_file_output") > 0;
+	if (per_file)
+	{
+		std::set<std::string> names;
+		for (const std::string &name : input_file_names)
+		{
+			if (!names.insert(per_file_output_path(per_file_folder, name, "")).second)
+			{
+				std::cerr << "Several input files named " << name << "." << std::endl;
+				return -1;
+			}
+		}
+	}
+
+	if (1 == input_file_names.size())
+	{
+		std::vector<long double> values;
+		try
+		{
+			column_reader_t reader(input_file_names.front());
+			values = reader.read_column(column, start_row);
+		}
+		catch (std::exception &e)
+		{
+			std::cerr << e.what() << std::endl;
+			return -1;
+		}
+		if(values.empty())
+		{
+			return -1;
+		}
+		std::vector<long double> autocorrelation_f = normalized_autocorrelation(std::move(values), max_lag, method);
+		if (per_file && !write_autocorrelation(per_file_output_path(per_file_folder, input_file_names.front(), "_autocorrelation.txt"), autocorrelation_f))
+		{
+			std::cerr << "Invalid output file." << std::endl;
+			return -1;
+		}
+		if (!write_autocorrelation(output_file_name, autocorrelation_f))
+		{
+			std::cerr << "Invalid output file." << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	// sums over the files of the autocorrelation and its square per lag, for the lags every file has
+	std::vector<long double> sums;
+	std::vector<long double> square_sums;
+	std::size_t lag_count = std::numeric_limits<std::size_t>::max();
+	try
+	{
+		for (std::size_t first = 0; first < input_file_names.size(); first += batch_block_size)
+		{
+			const std::size_t last = std::min(first + batch_block_size, input_file_names.size());
+			std::vector<std::vector<long double> > block(last - first);
+			parallel_for_files(input_file_names, first, last, [&](std::size_t i) {
+				std::vector<long double> values = column_reader_t(input_file_names[i]).read_column(column, start_row);
+				if (values.empty())
+				{
+					throw std::runtime_error("No values in input file.");
+				}
+				block[i - first] = normalized_autocorrelation(std::move(values), max_lag, method);
+				if (per_file && !write_autocorrelation(per_file_output_path(per_file_folder, input_file_names[i], "_autocorrelation.txt"), block[i - first]))
+				{
+					throw std::runtime_error("Invalid output file.");
+				}
+			});
+			for (const std::vector<long double> &autocorrelation_f : block)
+			{
+				lag_count = std::min(lag_count, autocorrelation_f.size());
+				sums.resize(lag_count, 0.);
+				square_sums.resize(lag_count, 0.);
+				for (std::size_t t = 0; t < lag_count; ++t)
+				{
+					sums[t] += autocorrelation_f[t];
+					square_sums[t] += autocorrelation_f[t] * autocorrelation_f[t];
+				}
+			}
+		}
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+
+	std::ofstream out(output_file_name);
+	if (!out.is_open())
+	{
+		std::cerr << "Invalid output file." << std::endl;
+		return -1;
+	}
+	const long double file_count = input_file_names.size();
+	out << "# files " << input_file_names.size() << '\n'
+		<< "# lag mean standard_error\n";
+	for(std::size_t i = 0; i < lag_count; ++i)
+	{
+		long double mean = sums[i] / file_count;
+		long double variance = std::max(0.0L, (square_sums[i] - file_count * mean * mean) / (file_count - 1));
+		out << i << " " << mean << " " << std::sqrt(variance / file_count) << '\n';
+	}
+	out.close();
+	return 0;
+}
@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <numeric>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <omp.h>
+
+#include "autocorrelation.hpp"
+#include "checkpoint.hpp"
+#include "column_reader.hpp"
+#include "csr_graph.hpp"
+#include "histogram.hpp"
+#include "model.hpp"
+#include "model_simulator.hpp"
+#include "node_ordering.hpp"
+#include "random.hpp"
+#include "statistics.hpp"
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+typedef std::chrono::steady_clock benchmark_clock_t;
+
+double seconds_since(benchmark_clock_t::time_point start)
+{
+    return std::chrono::duration<double>(benchmark_clock_t::now() - start).count();
+}
+
+// Fastest of 'repeat' runs of f(); f returns the amount of work it did
+// (steps, bytes, ...), which must be the same for every run.
+template <class function_t>
+double best_time(std::size_t repeat, function_t&& f, double& work)
+{
+    double best = 0.;
+    for (std::size_t k = 0; k < repeat; ++k) {
+        benchmark_clock_t::time_point start = benchmark_clock_t::now();
+        work = f();
+        double seconds = seconds_since(start);
+        if (0 == k || seconds < best) {
+            best = seconds;
+        }
+    }
+    return best;
+}
+
+// One JSON object per measurement, written as a flat list of fields.
+class json_record_t
+{
+public:
+    json_record_t& field(const std::string& name, const std::string& value)
+    {
+        fields_.emplace_back("\"" + name + "\": \"" + value + "\"");
+        return *this;
+    }
+
+    json_record_t& field(const std::string& name, double value)
+    {
+        std::ostringstream out;
+        out.precision(10);
+        out << value;
+        fields_.emplace_back("\"" + name + "\": " + out.str());
+        return *this;
+    }
+
+    std::string str() const
+    {
+        std::string result = "{";
+        for (std::size_t k = 0; k < fields_.size(); ++k) {
+            result += (k ? ", " : "") + fields_[k];
+        }
+        return result + "}";
+    }
+
+private:
+    std::vector<std::string> fields_;
+};
+
+// Steps per second of the discrete engine of model_type on the graph. Repetitions run
+// one after another until 'steps' steps have been done, so absorbed repetitions only
+// shorten the measured run, they never end it. With node_activity, the statistics track
+// the activity of every node.
+template <class model_type>
+double simulator_steps(const csr_graph_t& graph, const std::string& model, double lambda, std::size_t steps, std::uint64_t seed, bool node_activity = false)
+{
+    model_parameters_t parameters;
+    parameters.mu_ = 1.0;
+    parameters.lambda_ = lambda;
+    parameters.alpha_ = 1.0;
+    parameters.step_count_ = steps;
+    const model_type model_policy(parameters, graph);
+
+    simulation_settings_t settings;
+    settings.engine = "discrete";
+    settings.model = model;
+    settings.keep_intermediate_output = false;
+    settings.seed = seed;
+    settings.writer = nullptr;
+
+    const boost::dynamic_bitset<> initial_states(graph.node_count());
+    const time_binning_t binning = time_binning_t::dense(steps);
+    const observer_settings_t observer_settings;
+    const std::vector<lambda_statistics_t> no_statistics;
+    thread_checkpoint_t checkpoint(nullptr, 0, no_statistics);
+    model_simulator_t<model_type, xoshiro256pp_t> simulator(model_policy, settings, graph, initial_states);
+
+    // the progress lines of the step loop would mix with JSON written to standard output
+    std::cout.setstate(std::ios::failbit);
+    double done = 0.;
+    for (std::size_t r = 0; done < steps; ++r) {
+        lambda_statistics_t statistics(binning, observer_settings, node_activity ? graph.node_count() : 0);
+        simulator.simulate(r, statistics, checkpoint, r, nullptr);
+        const absorption_statistics_t& absorption = statistics.absorption_;
+        done += absorption.survived_ ? steps : absorption.survival_time_sum_;
+    }
+    std::cout.clear();
+    return done;
+}
+
+// Text file of 'i value' lines holding an AR(1) series, the layout of simulator output.
+std::size_t write_series(const std::string& path, std::size_t megabytes, std::uint64_t seed)
+{
+    std::ofstream out(path);
+    xoshiro256pp_t gen(seed, 0);
+    const std::size_t target = megabytes << 20;
+    std::size_t written = 0;
+    double x = 0.5;
+    std::string line;
+    for (std::size_t i = 0; written < target; ++i) {
+        x = 0.5 + 0.99 * (x - 0.5) + 0.01 * (uniform_real(gen) - 0.5);
+        std::ostringstream s;
+        s.precision(10);
+        s << i << " " << x << "\n";
+        line = s.str();
+        out << line;
+        written += line.size();
+    }
+    return written;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string parts;
+    std::string output_path;
+    std::string generator_path;
+    std::string work_folder;
+    std::size_t min_S = 0;
+    std::size_t max_S = 0;
+    std::size_t b = 0;
+    std::size_t M0 = 0;
+    double lambda = 0.;
+    std::size_t steps = 0;
+    std::size_t megabytes = 0;
+    std::size_t repeat = 0;
+    std::uint64_t seed = 0;
+    po::options_description desc("Program options");
+    desc.add_options()("help", "Produce help message")(
+        "parts", po::value<std::string>(&parts)->default_value("simulator,generator,layout,analysis"), "Comma separated benchmark parts: 'simulator' - steps per second of every model by S, 'generator' - network generation time by N, 'layout' - steps per second of model A by S with generator, shuffled and reverse Cuthill-McKee node numbering, 'activity' - steps per second of model A by S without and with per-node activity tracking, 'analysis' - parser, histogram and autocorrelation throughput.")(
+        "output", po::value<std::string>(&output_path)->default_value("benchmark.json"), "JSON result file; '-' writes to standard output.")(
+        "generator", po::value<std::string>(&generator_path)->default_value("../hmn_generator/bin/hmn_generator.exe"), "HMN generator executable")(
+        "work_folder", po::value<std::string>(&work_folder)->default_value(fs::temp_directory_path().string()), "Folder for the generated networks and data files, removed afterwards.")(
+        "min_S", po::value<std::size_t>(&min_S)->default_value(7), "Smallest level count of the generated networks")(
+        "max_S", po::value<std::size_t>(&max_S)->default_value(12), "Largest level count of the generated networks")(
+        "b", po::value<std::size_t>(&b)->default_value(2), "Block size of the generated networks")(
+        "M_0", po::value<std::size_t>(&M0)->default_value(2), "Module size of the generated networks")(
+        "lambda", po::value<double>(&lambda)->default_value(5.0), "Activity propagation rate of the simulator runs; high enough for activity to survive.")(
+        "steps", po::value<std::size_t>(&steps)->default_value(2 * 1000 * 1000), "Simulator steps per measurement")(
+        "megabytes", po::value<std::size_t>(&megabytes)->default_value(64), "Size of the analysis input file")(
+        "repeat", po::value<std::size_t>(&repeat)->default_value(3), "Runs per measurement; the fastest is reported.")(
+        "seed", po::value<std::uint64_t>(&seed)->default_value(1), "Random seed of networks, data and simulations, fixed so results stay comparable.");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (po::error& e) {
+        std::cerr << "\nError parsing command line: " << e.what() << std::endl
+                  << std::endl;
+        std::cerr << desc << std::endl;
+        return -1;
+    }
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    const bool run_simulator = std::string::npos != parts.find("simulator");
+    const bool run_generator = std::string::npos != parts.find("generator");
+    const bool run_layout = std::string::npos != parts.find("layout");
+    const bool run_activity = std::string::npos != parts.find("activity");
+    const bool run_analysis = std::string::npos != parts.find("analysis");
+
+    if (min_S > max_S || b < 2 || 0 == M0 || 0 == steps || 0 == megabytes || 0 == repeat) {
+        std::cerr << "Invalid benchmark settings." << std::endl;
+        return -1;
+    }
+
+    if ((run_simulator || run_generator || run_layout || run_activity) && !fs::exists(generator_path)) {
+        std::cerr << "Invalid generator path." << std::endl;
+        return -1;
+    }
+
+    const fs::path folder = fs::path(work_folder) / fs::unique_path("griffiths_benchmark_%%%%%%%%");
+    try {
+        fs::create_directories(folder);
+    } catch (fs::filesystem_error& e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+
+    std::vector<json_record_t> results;
+    try {
+        if (run_simulator || run_generator || run_layout || run_activity) {
+            for (std::size_t S = min_S; S <= max_S; ++S) {
+                // the generator is timed as a whole process, file output included
+                std::ostringstream network_name;
+                network_name << "network_" << S << ".bin";
+                const std::string network_path = (folder / network_name.str()).string();
+                std::ostringstream command;
+                command << "\"" << generator_path << "\" --S " << S << " --b " << b << " --M_0 " << M0 << " --seed " << seed
+                        << " --format binary --output \"" << network_path << "\" > /dev/null";
+                double status = 0.;
+                double seconds = best_time(run_generator ? repeat : 1, [&] { return static_cast<double>(std::system(command.str().c_str())); }, status);
+                if (0. != status) {
+                    throw std::runtime_error("The generator failed.");
+                }
+                const csr_graph_t graph = csr_graph_t::load(network_path);
+                std::cerr << "S = " << S << "; N = " << graph.node_count() << std::endl;
+                if (run_generator) {
+                    results.emplace_back(json_record_t()
+                                             .field("part", "generator")
+                                             .field("S", S)
+                                             .field("N", graph.node_count())
+                                             .field("edges", graph.edge_count())
+                                             .field("seconds", seconds)
+                                             .field("edges_per_second", graph.edge_count() / seconds));
+                }
+                if (run_simulator) {
+                    for (const std::string model : { "A", "B", "CP" }) {
+                        double done = 0.;
+                        double seconds = best_time(repeat, [&] {
+                            if (model == "A") {
+                                return simulator_steps<model_a_t>(graph, model, lambda, steps, seed);
+                            }
+                            if (model == "B") {
+                                return simulator_steps<model_b_t>(graph, model, lambda, steps, seed);
+                            }
+                            return simulator_steps<model_cp_t>(graph, model, lambda, steps, seed);
+                        }, done);
+                        results.emplace_back(json_record_t()
+                                                 .field("part", "simulator")
+                                                 .field("model", model)
+                                                 .field("S", S)
+                                                 .field("N", graph.node_count())
+                                                 .field("steps", done)
+                                                 .field("seconds", seconds)
+                                                 .field("steps_per_second", done / seconds));
+                    }
+                }
+                if (run_layout) {
+                    // a random numbering stands for an input network without locality
+                    std::vector<node_t> shuffle(graph.node_count());
+                    std::iota(shuffle.begin(), shuffle.end(), node_t(0));
+                    xoshiro256pp_t gen(seed, S);
+                    for (std::size_t i = shuffle.size(); i > 1; --i) {
+                        std::swap(shuffle[i - 1], shuffle[uniform_index(gen, i)]);
+                    }
+                    const csr_graph_t shuffled = graph.permuted(shuffle);
+                    benchmark_clock_t::time_point start = benchmark_clock_t::now();
+                    const csr_graph_t reordered = shuffled.permuted(make_node_permutation(shuffled, "rcm").new_index());
+                    const double reorder_seconds = seconds_since(start);
+                    const std::pair<const char*, const csr_graph_t*> layouts[] = { { "generator", &graph }, { "shuffled", &shuffled }, { "rcm", &reordered } };
+                    for (const auto& layout : layouts) {
+                        double done = 0.;
+                        double seconds = best_time(repeat, [&] { return simulator_steps<model_a_t>(*layout.second, "A", lambda, steps, seed); }, done);
+                        json_record_t record;
+                        record.field("part", "layout").field("ordering", layout.first).field("S", S).field("N", graph.node_count()).field("steps", done).field("seconds", seconds).field("steps_per_second", done / seconds);
+                        if (layout.second == &reordered) {
+                            record.field("reorder_seconds", reorder_seconds);
+                        }
+                        results.emplace_back(record);
+                    }
+                }
+                if (run_activity) {
+                    // the overhead of the node activity hooks in the active set
+                    double seconds_without = 0.;
+                    for (bool node_activity : { false, true }) {
+                        double done = 0.;
+                        double seconds = best_time(repeat, [&] { return simulator_steps<model_a_t>(graph, "A", lambda, steps, seed, node_activity); }, done);
+                        json_record_t record;
+                        record.field("part", "activity").field("node_activity", node_activity ? "on" : "off").field("S", S).field("N", graph.node_count()).field("steps", done).field("seconds", seconds).field("steps_per_second", done / seconds);
+                        if (node_activity) {
+                            record.field("overhead", seconds / seconds_without - 1.);
+                        }
+                        seconds_without = seconds;
+                        results.emplace_back(record);
+                    }
+                }
+                fs::remove(network_path);
+            }
+        }
+
+        if (run_analysis) {
+            // every stage is rated against the size of the text input it stands for
+            const std::string data_path = (folder / "series.txt").string();
+            const double bytes = write_series(data_path, megabytes, seed);
+            const double megabyte_count = bytes / (1 << 20);
+            std::vector<long double> values;
+            double work = 0.;
+
+            double seconds = best_time(repeat, [&] {
+                values = column_reader_t(data_path).read_column(2, 0);
+                return static_cast<double>(values.size());
+            }, work);
+            const double n = values.size();
+            results.emplace_back(json_record_t()
+                                     .field("part", "parser")
+                                     .field("values", n)
+                                     .field("bytes", bytes)
+                                     .field("seconds", seconds)
+                                     .field("megabytes_per_second", megabyte_count / seconds));
+
+            const histogram_binning_t binning = histogram_binning_t::linear(0., 1., 1e-4);
+            seconds = best_time(repeat, [&] {
+                histogram_t histogram(binning);
+                for (long double v : values) {
+                    histogram.add(static_cast<double>(v));
+                }
+                return static_cast<double>(histogram.total());
+            }, work);
+            results.emplace_back(json_record_t()
+                                     .field("part", "histogram")
+                                     .field("values", n)
+                                     .field("bins", binning.size())
+                                     .field("seconds", seconds)
+                                     .field("megabytes_per_second", megabyte_count / seconds));
+
+            long double mean = 0.;
+            for (long double v : values) {
+                mean += v;
+            }
+            mean /= values.size();
+            for (long double& v : values) {
+                v -= mean;
+            }
+            // the FFT covers all lags at once, the direct kernel is meant for short ones
+            const std::size_t fft_lag = values.size() / 2;
+            const std::size_t direct_lag = 256;
+            for (const std::string method : { "fft", "direct" }) {
+                const std::size_t max_lag = method == "fft" ? fft_lag : direct_lag;
+                seconds = best_time(repeat, [&] {
+                    std::vector<long double> c = method == "fft" ? autocorrelation_fft(values, max_lag) : autocorrelation_direct(values, max_lag);
+                    return static_cast<double>(c.size());
+                }, work);
+                results.emplace_back(json_record_t()
+                                         .field("part", "autocorrelation")
+                                         .field("method", method)
+                                         .field("values", n)
+                                         .field("max_lag", max_lag)
+                                         .field("seconds", seconds)
+                                         .field("megabytes_per_second", megabyte_count / seconds));
+            }
+            fs::remove(data_path);
+        }
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        boost::system::error_code error;
+        fs::remove_all(folder, error);
+        return -1;
+    }
+    fs::remove_all(folder);
+
+    std::ostringstream json;
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    json << "{\n  \"date\": \"" << date << "\",\n  \"threads\": " << omp_get_max_threads() << ",\n  \"results\": [\n";
+    for (std::size_t k = 0; k < results.size(); ++k) {
+        json << "    " << results[k].str() << (k + 1 < results.size() ? ",\n" : "\n");
+    }
+    json << "  ]\n}\n";
+
+    if (output_path == "-") {
+        std::cout << json.str();
+    } else {
+        std::ofstream out(output_path);
+        if (!out.is_open()) {
+            std::cerr << "Cannot create output file." << std::endl;
+            return -1;
+        }
+        out << json.str();
+    }
+    return 0;
+}
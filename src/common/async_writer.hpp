@@ -0,0 +1,160 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Background thread that appends byte chunks to files. Producers hand over a
+// filled buffer and immediately get a recycled one back (double buffering),
+// so they only ever wait when more than max_pending_bytes are queued, which
+// keeps memory bounded if the disk cannot keep up.
+class async_writer_t
+{
+public:
+    typedef std::vector<char> buffer_t;
+    typedef std::shared_ptr<std::ofstream> file_t;
+
+    explicit async_writer_t(std::size_t max_pending_bytes)
+        : max_pending_bytes_(max_pending_bytes)
+        , pending_bytes_(0)
+        , busy_(false)
+        , stopping_(false)
+        , failed_(false)
+    {
+        thread_ = std::thread([this] { run(); });
+    }
+
+    async_writer_t(const async_writer_t&) = delete;
+    async_writer_t& operator=(const async_writer_t&) = delete;
+
+    ~async_writer_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        job_added_.notify_one();
+        thread_.join();
+    }
+
+    // Queues the buffer to be appended to the file and returns an empty buffer to fill next.
+    buffer_t write(const file_t& file, buffer_t&& data)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        job_done_.wait(lock, [this] { return pending_bytes_ < max_pending_bytes_; });
+        pending_bytes_ += data.size();
+        jobs_.emplace_back(job_t{ file, std::move(data), false, std::string(), std::string() });
+        buffer_t spare;
+        if (!spare_.empty()) {
+            spare = std::move(spare_.back());
+            spare_.pop_back();
+        }
+        lock.unlock();
+        job_added_.notify_one();
+        return spare;
+    }
+
+    // Queues closing of the file after all its pending chunks.
+    void close(const file_t& file)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.emplace_back(job_t{ file, buffer_t(), true, std::string(), std::string() });
+        }
+        job_added_.notify_one();
+    }
+
+    // Queues closing of the file written at temporary_path and renaming it to path,
+    // so readers of path see either the previous or the complete new content.
+    void commit(const file_t& file, const std::string& temporary_path, const std::string& path)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.emplace_back(job_t{ file, buffer_t(), true, temporary_path, path });
+        }
+        job_added_.notify_one();
+    }
+
+    // Waits until every queued job is written.
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        job_done_.wait(lock, [this] { return jobs_.empty() && !busy_; });
+    }
+
+    // True if any write failed so far.
+    bool failed() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return failed_;
+    }
+
+private:
+    struct job_t
+    {
+        file_t file;
+        buffer_t data;
+        bool close;
+        std::string rename_from; // set for commit()
+        std::string rename_to;
+    };
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            job_added_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+            if (jobs_.empty()) {
+                return;
+            }
+            job_t job = std::move(jobs_.front());
+            jobs_.pop_front();
+            busy_ = true;
+            lock.unlock();
+
+            bool ok = true;
+            if (job.close) {
+                ok = job.rename_from.empty() || static_cast<bool>(job.file->flush());
+                job.file->close();
+                if (ok && !job.rename_from.empty()) {
+                    ok = 0 == std::rename(job.rename_from.c_str(), job.rename_to.c_str());
+                }
+            } else {
+                job.file->write(job.data.data(), job.data.size());
+                ok = static_cast<bool>(*job.file);
+            }
+
+            lock.lock();
+            busy_ = false;
+            failed_ = failed_ || !ok;
+            pending_bytes_ -= job.data.size();
+            if (!job.close && spare_.size() < max_spare_buffers) {
+                job.data.clear();
+                spare_.emplace_back(std::move(job.data));
+            }
+            job_done_.notify_all();
+        }
+    }
+
+    static constexpr std::size_t max_spare_buffers = 64;
+
+    const std::size_t max_pending_bytes_;
+    std::size_t pending_bytes_;
+    bool busy_;
+    bool stopping_;
+    bool failed_;
+    std::deque<job_t> jobs_;
+    std::vector<buffer_t> spare_;
+    mutable std::mutex mutex_;
+    std::condition_variable job_added_;
+    std::condition_variable job_done_;
+    std::thread thread_;
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+// Autocorrelation kernels. All of them compute the raw lag sums
+//   c[t] = sum_{i < n - t} x[i] * x[i + t],  t < max_lag
+// of an already centered series; normalization is left to the caller.
+
+// In-place iterative radix-2 FFT; data.size() must be a power of two.
+inline void fft(std::vector<std::complex<double> >& data, bool inverse)
+{
+    const std::size_t n = data.size();
+    for (std::size_t i = 1, j = 0; i < n; ++i) {
+        std::size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(data[i], data[j]);
+        }
+    }
+    const double sign = inverse ? 1.0 : -1.0;
+    for (std::size_t length = 2; length <= n; length <<= 1) {
+        const std::size_t half = length / 2;
+        // twiddles of this stage computed directly to avoid error accumulation
+        std::vector<std::complex<double> > w(half);
+        for (std::size_t k = 0; k < half; ++k) {
+            double angle = sign * 2.0 * M_PI * k / length;
+            w[k] = std::complex<double>(std::cos(angle), std::sin(angle));
+        }
+        for (std::size_t start = 0; start < n; start += length) {
+            for (std::size_t k = 0; k < half; ++k) {
+                std::complex<double> u = data[start + k];
+                std::complex<double> v = data[start + k + half] * w[k];
+                data[start + k] = u + v;
+                data[start + k + half] = u - v;
+            }
+        }
+    }
+}
+
+inline std::size_t next_power_of_two(std::size_t n)
+{
+    std::size_t m = 1;
+    while (m < n) {
+        m <<= 1;
+    }
+    return m;
+}
+
+// Wiener-Khinchin: the lag sums are the inverse transform of the power spectrum.
+// The series is zero padded to at least n + max_lag points so the circular
+// correlation does not wrap into the requested lags. O(n log n).
+inline std::vector<long double> autocorrelation_fft(const std::vector<long double>& values, std::size_t max_lag)
+{
+    const std::size_t n = values.size();
+    max_lag = std::min(max_lag, n);
+    const std::size_t m = next_power_of_two(n + max_lag);
+    std::vector<std::complex<double> > data(m);
+    for (std::size_t i = 0; i < n; ++i) {
+        data[i] = static_cast<double>(values[i]);
+    }
+    fft(data, false);
+    for (std::complex<double>& c : data) {
+        c = std::norm(c);
+    }
+    fft(data, true);
+    std::vector<long double> sums(max_lag);
+    for (std::size_t t = 0; t < max_lag; ++t) {
+        sums[t] = data[t].real() / m;
+    }
+    return sums;
+}
+
+// Direct summation over the first max_lag lags, O(n * max_lag). Lags are
+// processed in blocks that share each loaded x[i], with independent double
+// accumulators the compiler can vectorize; every chunk of the series is
+// flushed into long double totals to keep the accuracy of the old kernel.
+inline std::vector<long double> autocorrelation_direct(const std::vector<long double>& values, std::size_t max_lag)
+{
+    const std::size_t n = values.size();
+    max_lag = std::min(max_lag, n);
+    const std::vector<double> x(values.begin(), values.end());
+    std::vector<long double> sums(max_lag, 0.0L);
+
+    const std::size_t lag_block = 8;
+    const std::size_t chunk = 4096;
+    for (std::size_t t0 = 0; t0 < max_lag; t0 += lag_block) {
+        const std::size_t lags = std::min(lag_block, max_lag - t0);
+        // for i < full_end every lag of the block has its pair inside the series
+        const std::size_t full_end = n - (t0 + lags - 1);
+        for (std::size_t begin = 0; begin < full_end; begin += chunk) {
+            const std::size_t end = std::min(begin + chunk, full_end);
+            double acc[lag_block] = {};
+            if (lags == lag_block) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    const double xi = x[i];
+                    const double* y = &x[i + t0];
+                    for (std::size_t j = 0; j < lag_block; ++j) {
+                        acc[j] += xi * y[j];
+                    }
+                }
+            } else {
+                for (std::size_t i = begin; i < end; ++i) {
+                    for (std::size_t j = 0; j < lags; ++j) {
+                        acc[j] += x[i] * x[i + t0 + j];
+                    }
+                }
+            }
+            for (std::size_t j = 0; j < lags; ++j) {
+                sums[t0 + j] += acc[j];
+            }
+        }
+        // tail where the longer lags of the block run past the end of the series
+        for (std::size_t i = full_end; i < n - t0; ++i) {
+            for (std::size_t j = 0; j < lags && i + t0 + j < n; ++j) {
+                sums[t0 + j] += x[i] * x[i + t0 + j];
+            }
+        }
+    }
+    return sums;
+}
+
+// Picks the cheaper kernel from rough operation counts.
+inline bool autocorrelation_prefers_fft(std::size_t n, std::size_t max_lag)
+{
+    max_lag = std::min(max_lag, n);
+    const double m = static_cast<double>(next_power_of_two(n + max_lag));
+    const double fft_cost = 10.0 * m * std::log2(m);
+    const double direct_cost = static_cast<double>(n) * max_lag;
+    return fft_cost < direct_cost;
+}
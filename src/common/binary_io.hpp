@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Native-endian serialization of plain values, vectors of them and strings
+// into a byte buffer, for files only read back by the same build (checkpoints).
+class binary_writer_t
+{
+public:
+    explicit binary_writer_t(std::vector<char>& out)
+        : out_(out)
+    {
+    }
+
+    template <class T>
+    void write(const T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+        const char* bytes = reinterpret_cast<const char*>(&value);
+        out_.insert(out_.end(), bytes, bytes + sizeof(T));
+    }
+
+    template <class T>
+    void write(const std::vector<T>& values)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+        write(static_cast<std::uint64_t>(values.size()));
+        if (!values.empty()) {
+            const char* bytes = reinterpret_cast<const char*>(values.data());
+            out_.insert(out_.end(), bytes, bytes + values.size() * sizeof(T));
+        }
+    }
+
+    void write(const std::string& value)
+    {
+        write(std::vector<char>(value.begin(), value.end()));
+    }
+
+private:
+    std::vector<char>& out_;
+};
+
+class binary_reader_t
+{
+public:
+    binary_reader_t(const char* begin, const char* end)
+        : p_(begin)
+        , end_(end)
+    {
+    }
+
+    template <class T>
+    void read(T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+        take(&value, sizeof(T));
+    }
+
+    template <class T>
+    void read(std::vector<T>& values)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+        std::uint64_t size = 0;
+        read(size);
+        if (size > static_cast<std::uint64_t>(end_ - p_) / sizeof(T)) {
+            throw std::runtime_error("Truncated binary data.");
+        }
+        values.resize(size);
+        take(values.data(), size * sizeof(T));
+    }
+
+    void read(std::string& value)
+    {
+        std::vector<char> chars;
+        read(chars);
+        value.assign(chars.begin(), chars.end());
+    }
+
+    bool at_end() const
+    {
+        return p_ == end_;
+    }
+
+private:
+    void take(void* data, std::size_t size)
+    {
+        if (static_cast<std::size_t>(end_ - p_) < size) {
+            throw std::runtime_error("Truncated binary data.");
+        }
+        if (size > 0) {
+            std::memcpy(data, p_, size);
+            p_ += size;
+        }
+    }
+
+    const char* p_;
+    const char* end_;
+};
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <omp.h>
+
+// Reader of whitespace separated numeric text files (simulator trajectories,
+// histograms, node lists). The file is memory mapped and lines are scanned in
+// place; each requested field is copied into a small stack buffer for strtold
+// (fields of 64 characters or more into a string). Integer lists are parsed in
+// place with std::from_chars.
+//
+// Numbers are converted to long double like std::stold, with strtold: a
+// leading '+', exponents, "inf" and "nan" are accepted, but unlike stold the
+// whole field must be a number. Columns are 1-based. The first skip_rows lines
+// are skipped but must still contain the requested columns, like the original
+// getline/regex readers; blank lines count as skipped lines there and are
+// ignored among the data lines.
+class column_reader_t
+{
+public:
+    explicit column_reader_t(const std::string& path)
+        : begin_(nullptr)
+        , end_(nullptr)
+    {
+        std::ifstream probe(path, std::ios::binary | std::ios::ate);
+        if (!probe.is_open()) {
+            throw std::runtime_error("Cannot open input file.");
+        }
+        // an empty file cannot be mapped
+        if (0 == probe.tellg()) {
+            return;
+        }
+        namespace bip = boost::interprocess;
+        try {
+            bip::file_mapping file(path.c_str(), bip::read_only);
+            region_.reset(new bip::mapped_region(file, bip::read_only));
+        } catch (bip::interprocess_exception&) {
+            throw std::runtime_error("Cannot map input file.");
+        }
+        begin_ = static_cast<const char*>(region_->get_address());
+        end_ = begin_ + region_->get_size();
+    }
+
+    std::size_t size() const
+    {
+        return end_ - begin_;
+    }
+
+    // Calls visitor(const long double* values) for every data line, values holding
+    // the requested columns in the order given.
+    template <class visitor_t>
+    void for_each(const std::vector<std::size_t>& columns, std::size_t skip_rows, visitor_t&& visitor) const
+    {
+        const line_parser_t parser(columns);
+        const char* data = skip(parser, skip_rows);
+        parse_range(parser, data, end_, visitor);
+    }
+
+    // Same as for_each(), but the data lines are split into visitors.size()
+    // contiguous chunks parsed in parallel; visitors[k] sees chunk k in order.
+    template <class visitor_t>
+    void parallel_for_each(const std::vector<std::size_t>& columns, std::size_t skip_rows, std::vector<visitor_t>& visitors) const
+    {
+        const line_parser_t parser(columns);
+        const char* data = skip(parser, skip_rows);
+        const std::size_t chunk_count = visitors.size();
+        std::vector<const char*> bounds(chunk_count + 1, end_);
+        bounds[0] = data;
+        for (std::size_t k = 1; k < chunk_count; ++k) {
+            const char* p = std::max(bounds[k - 1], data + (end_ - data) * k / chunk_count);
+            bounds[k] = line_end(p, end_);
+            if (bounds[k] != end_) {
+                ++bounds[k];
+            }
+        }
+        std::vector<std::exception_ptr> errors(chunk_count);
+#pragma omp parallel for schedule(static, 1)
+        for (std::size_t k = 0; k < chunk_count; ++k) {
+            try {
+                parse_range(parser, bounds[k], bounds[k + 1], visitors[k]);
+            } catch (...) {
+                errors[k] = std::current_exception();
+            }
+        }
+        for (const std::exception_ptr& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    // Values of one column; files larger than a few megabytes are parsed in parallel.
+    std::vector<long double> read_column(std::size_t column, std::size_t skip_rows) const
+    {
+        const std::vector<std::size_t> columns(1, column);
+        std::size_t chunk_count = size() < parallel_threshold ? 1 : static_cast<std::size_t>(omp_get_max_threads());
+        std::vector<collector_t> collectors(chunk_count);
+        parallel_for_each(columns, skip_rows, collectors);
+        std::size_t total = 0;
+        for (const collector_t& c : collectors) {
+            total += c.values.size();
+        }
+        std::vector<long double> values;
+        values.reserve(total);
+        for (const collector_t& c : collectors) {
+            values.insert(values.end(), c.values.begin(), c.values.end());
+        }
+        return values;
+    }
+
+    // Every whitespace separated token of the file as an unsigned integer (e.g. a node list).
+    std::vector<std::uint64_t> read_integers() const
+    {
+        std::vector<std::uint64_t> values;
+        const char* p = begin_;
+        while (p != end_) {
+            if (is_space(*p)) {
+                ++p;
+                continue;
+            }
+            std::uint64_t value = 0;
+            std::from_chars_result result = std::from_chars(p, end_, value);
+            if (result.ec != std::errc() || (result.ptr != end_ && !is_space(*result.ptr))) {
+                throw std::runtime_error("Invalid input data: not an unsigned integer.");
+            }
+            values.push_back(value);
+            p = result.ptr;
+        }
+        return values;
+    }
+
+private:
+    static constexpr std::size_t parallel_threshold = 4 << 20;
+
+    struct collector_t
+    {
+        std::vector<long double> values;
+        void operator()(const long double* v)
+        {
+            values.push_back(v[0]);
+        }
+    };
+
+    // Maps 0-based field index to the output slot (or -1) and parses a line.
+    class line_parser_t
+    {
+    public:
+        explicit line_parser_t(const std::vector<std::size_t>& columns)
+            : values_(columns.size())
+        {
+            for (std::size_t k = 0; k < columns.size(); ++k) {
+                if (0 == columns[k]) {
+                    throw std::runtime_error("Column numbers are 1-based.");
+                }
+                if (columns[k] > slots_.size()) {
+                    slots_.resize(columns[k], -1);
+                }
+                slots_[columns[k] - 1] = static_cast<int>(k);
+            }
+            // a column may be requested twice; copies are resolved after parsing
+            for (std::size_t k = 0; k < columns.size(); ++k) {
+                copies_.push_back(slots_[columns[k] - 1]);
+            }
+        }
+
+        // Parses [begin, end) into values; returns false if the line has too few fields.
+        bool parse(const char* begin, const char* end, long double* values, bool convert) const
+        {
+            std::size_t field = 0;
+            const char* p = begin;
+            while (field < slots_.size()) {
+                while (p != end && is_space(*p)) {
+                    ++p;
+                }
+                if (p == end) {
+                    return false;
+                }
+                const char* token_end = p;
+                while (token_end != end && !is_space(*token_end)) {
+                    ++token_end;
+                }
+                int slot = slots_[field];
+                if (convert && slot >= 0) {
+                    values[slot] = to_long_double(p, token_end);
+                }
+                p = token_end;
+                ++field;
+            }
+            if (convert) {
+                for (std::size_t k = 0; k < copies_.size(); ++k) {
+                    values[k] = values[copies_[k]];
+                }
+            }
+            return true;
+        }
+
+        std::size_t value_count() const
+        {
+            return values_;
+        }
+
+    private:
+        std::vector<int> slots_;
+        std::vector<int> copies_;
+        std::size_t values_;
+    };
+
+    // strtold needs a terminated string, and the mapped field is not one.
+    static long double to_long_double(const char* begin, const char* end)
+    {
+        char buffer[64];
+        std::string long_field;
+        const std::size_t length = end - begin;
+        const char* field = buffer;
+        if (length < sizeof(buffer)) {
+            std::memcpy(buffer, begin, length);
+            buffer[length] = '\0';
+        } else {
+            long_field.assign(begin, end);
+            field = long_field.c_str();
+        }
+        char* parsed = nullptr;
+        const long double value = std::strtold(field, &parsed);
+        if (parsed != field + length) {
+            throw std::runtime_error("Invalid input data: '" + std::string(begin, end) + "' is not a number.");
+        }
+        return value;
+    }
+
+    static bool is_space(char c)
+    {
+        return ' ' == c || '\t' == c || '\r' == c || '\n' == c || '\v' == c || '\f' == c;
+    }
+
+    static bool is_blank(const char* begin, const char* end)
+    {
+        for (; begin != end; ++begin) {
+            if (!is_space(*begin)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static const char* line_end(const char* p, const char* end)
+    {
+        const void* newline = std::memchr(p, '\n', end - p);
+        return newline ? static_cast<const char*>(newline) : end;
+    }
+
+    // Checks the skipped header lines and returns the start of the data lines.
+    const char* skip(const line_parser_t& parser, std::size_t skip_rows) const
+    {
+        const char* p = begin_;
+        std::vector<long double> values(parser.value_count());
+        while (skip_rows > 0 && p != end_) {
+            const char* eol = line_end(p, end_);
+            if (!is_blank(p, eol) && !parser.parse(p, eol, values.data(), false)) {
+                throw std::runtime_error("Invalid input data: one of the lines does not contain enough columns.");
+            }
+            --skip_rows;
+            p = eol == end_ ? end_ : eol + 1;
+        }
+        return p;
+    }
+
+    template <class visitor_t>
+    static void parse_range(const line_parser_t& parser, const char* p, const char* end, visitor_t& visitor)
+    {
+        std::vector<long double> values(parser.value_count());
+        while (p < end) {
+            const char* eol = line_end(p, end);
+            if (!is_blank(p, eol)) {
+                if (!parser.parse(p, eol, values.data(), true)) {
+                    throw std::runtime_error("Invalid input data: one of the lines does not contain enough columns.");
+                }
+                visitor(static_cast<const long double*>(values.data()));
+            }
+            p = eol == end ? end : eol + 1;
+        }
+    }
+
+    std::unique_ptr<boost::interprocess::mapped_region> region_;
+    const char* begin_;
+    const char* end_;
+};
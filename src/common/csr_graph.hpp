@@ -0,0 +1,361 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// Node index type shared by the generator and the simulator.
+typedef std::uint32_t node_t;
+
+// Undirected graph in compressed sparse row form. Neighbours of node i are
+// targets[offsets[i] .. offsets[i + 1]), sorted in increasing order.
+//
+// The graph either owns its arrays or views them inside a memory mapped
+// binary network file (see write_binary() for the layout).
+class csr_graph_t
+{
+public:
+    class neighbour_range_t
+    {
+    public:
+        neighbour_range_t(const node_t* begin, const node_t* end)
+            : begin_(begin)
+            , end_(end)
+        {
+        }
+        const node_t* begin() const { return begin_; }
+        const node_t* end() const { return end_; }
+        std::size_t size() const { return end_ - begin_; }
+        bool empty() const { return begin_ == end_; }
+        node_t operator[](std::size_t i) const { return begin_[i]; }
+
+    private:
+        const node_t* begin_;
+        const node_t* end_;
+    };
+
+    csr_graph_t()
+        : node_count_(0)
+        , offsets_(nullptr)
+        , targets_(nullptr)
+    {
+        offsets_storage_.assign(1, 0);
+        offsets_ = offsets_storage_.data();
+    }
+
+    csr_graph_t(const csr_graph_t&) = delete;
+    csr_graph_t& operator=(const csr_graph_t&) = delete;
+
+    csr_graph_t(csr_graph_t&& other) { *this = std::move(other); }
+
+    csr_graph_t& operator=(csr_graph_t&& other)
+    {
+        node_count_ = other.node_count_;
+        offsets_storage_ = std::move(other.offsets_storage_);
+        targets_storage_ = std::move(other.targets_storage_);
+        mapping_ = std::move(other.mapping_);
+        if (mapping_) {
+            offsets_ = other.offsets_;
+            targets_ = other.targets_;
+        } else {
+            offsets_ = offsets_storage_.data();
+            targets_ = targets_storage_.data();
+        }
+        other.node_count_ = 0;
+        other.offsets_storage_.assign(1, 0);
+        other.offsets_ = other.offsets_storage_.data();
+        other.targets_ = nullptr;
+        return *this;
+    }
+
+    typedef std::pair<node_t, node_t> edge_t;
+
+    // Builds the graph from an undirected edge list. Each edge is stored in
+    // both directions; self loops and duplicate edges are dropped.
+    static csr_graph_t from_edges(std::size_t node_count, const std::vector<edge_t>& edges)
+    {
+        return from_edge_buffers(node_count, &edges, &edges + 1);
+    }
+
+    // Same as from_edges() for an edge list split over several buffers (e.g. one per
+    // thread). Rows are sorted, so the result does not depend on the edge order.
+    static csr_graph_t from_edge_buffers(std::size_t node_count, const std::vector<edge_t>* first_buffer, const std::vector<edge_t>* last_buffer)
+    {
+        std::size_t edge_count = 0;
+        for (const std::vector<edge_t>* buffer = first_buffer; buffer != last_buffer; ++buffer) {
+            edge_count += buffer->size();
+        }
+        if (node_count > std::numeric_limits<node_t>::max() || 2 * edge_count > std::numeric_limits<node_t>::max()) {
+            throw std::runtime_error("Network is too large for 32-bit indices.");
+        }
+        std::vector<node_t> degrees(node_count + 1, 0);
+        for (const std::vector<edge_t>* buffer = first_buffer; buffer != last_buffer; ++buffer) {
+            for (const auto& e : *buffer) {
+                if (e.first >= node_count || e.second >= node_count) {
+                    throw std::runtime_error("Invalid vertex index.");
+                }
+                if (e.first != e.second) {
+                    ++degrees[e.first + 1];
+                    ++degrees[e.second + 1];
+                }
+            }
+        }
+        for (std::size_t i = 0; i < node_count; ++i) {
+            degrees[i + 1] += degrees[i];
+        }
+        std::vector<node_t> targets(degrees[node_count]);
+        std::vector<node_t> fill(degrees.begin(), degrees.end() - 1);
+        for (const std::vector<edge_t>* buffer = first_buffer; buffer != last_buffer; ++buffer) {
+            for (const auto& e : *buffer) {
+                if (e.first != e.second) {
+                    targets[fill[e.first]++] = e.second;
+                    targets[fill[e.second]++] = e.first;
+                }
+            }
+        }
+
+        // sort rows and squeeze out duplicates in place
+        csr_graph_t graph;
+        graph.node_count_ = node_count;
+        graph.offsets_storage_.assign(node_count + 1, 0);
+        node_t out = 0;
+        for (std::size_t i = 0; i < node_count; ++i) {
+            auto first = targets.begin() + degrees[i];
+            auto last = targets.begin() + degrees[i + 1];
+            std::sort(first, last);
+            last = std::unique(first, last);
+            out = static_cast<node_t>(std::copy(first, last, targets.begin() + out) - targets.begin());
+            graph.offsets_storage_[i + 1] = out;
+        }
+        targets.resize(out);
+        targets.shrink_to_fit();
+        graph.targets_storage_ = std::move(targets);
+        graph.offsets_ = graph.offsets_storage_.data();
+        graph.targets_ = graph.targets_storage_.data();
+        return graph;
+    }
+
+    // Loads a network from either the binary format or the text format
+    // ('N' followed by 'v1 v2' edge lines). The format is detected by the
+    // magic bytes at the beginning of the file.
+    static csr_graph_t load(const std::string& path)
+    {
+        {
+            std::ifstream probe(path, std::ios::binary);
+            if (!probe.is_open()) {
+                throw std::runtime_error("Cannot open network file.");
+            }
+            char magic[binary_magic_size] = {};
+            probe.read(magic, sizeof(magic));
+            if (probe.gcount() == sizeof(magic) && 0 == std::memcmp(magic, binary_magic(), binary_magic_size)) {
+                return map_binary(path);
+            }
+        }
+        return read_text(path);
+    }
+
+    static csr_graph_t read_text(const std::string& path)
+    {
+        std::ifstream network_file(path);
+        if (!network_file.is_open()) {
+            throw std::runtime_error("Cannot open network file.");
+        }
+        std::size_t N = 0;
+        network_file >> N;
+        std::vector<edge_t> edges;
+        std::size_t v1, v2;
+        while (network_file >> v1 >> v2) {
+            if (v1 >= N || v2 >= N) {
+                throw std::runtime_error("Invalid vertex index.");
+            }
+            edges.emplace_back(static_cast<node_t>(v1), static_cast<node_t>(v2));
+        }
+        return from_edges(N, edges);
+    }
+
+    // Maps a binary network file into memory without copying the arrays.
+    static csr_graph_t map_binary(const std::string& path)
+    {
+        namespace bip = boost::interprocess;
+        auto mapping = std::make_shared<mapping_t>();
+        try {
+            bip::file_mapping file(path.c_str(), bip::read_only);
+            mapping->region = bip::mapped_region(file, bip::read_only);
+        } catch (bip::interprocess_exception&) {
+            throw std::runtime_error("Cannot map network file.");
+        }
+        const char* data = static_cast<const char*>(mapping->region.get_address());
+        std::size_t size = mapping->region.get_size();
+        if (size < sizeof(binary_header_t)) {
+            throw std::runtime_error("Truncated network file.");
+        }
+        binary_header_t header;
+        std::memcpy(&header, data, sizeof(header));
+        if (0 != std::memcmp(header.magic, binary_magic(), binary_magic_size) || binary_version != header.version || sizeof(node_t) != header.index_bytes) {
+            throw std::runtime_error("Unsupported network file format.");
+        }
+        // node ids and offsets are node_t, which also keeps the size below from overflowing
+        const std::uint64_t max_index = std::numeric_limits<node_t>::max();
+        if (header.node_count >= max_index || header.entry_count > max_index) {
+            throw std::runtime_error("Invalid network file.");
+        }
+        std::size_t expected = sizeof(header) + (header.node_count + 1 + header.entry_count) * sizeof(node_t);
+        if (size < expected) {
+            throw std::runtime_error("Truncated network file.");
+        }
+        // the arrays are checked once here, so the step loops can index them unchecked
+        const node_t* offsets = reinterpret_cast<const node_t*>(data + sizeof(header));
+        const node_t* targets = offsets + header.node_count + 1;
+        if (0 != offsets[0] || header.entry_count != offsets[header.node_count]) {
+            throw std::runtime_error("Invalid network file.");
+        }
+        for (std::size_t i = 0; i < header.node_count; ++i) {
+            if (offsets[i + 1] < offsets[i]) {
+                throw std::runtime_error("Invalid network file.");
+            }
+        }
+        for (std::size_t e = 0; e < header.entry_count; ++e) {
+            if (targets[e] >= header.node_count) {
+                throw std::runtime_error("Invalid vertex index.");
+            }
+        }
+        csr_graph_t graph;
+        graph.node_count_ = header.node_count;
+        graph.offsets_storage_.clear();
+        graph.offsets_ = offsets;
+        graph.targets_ = targets;
+        graph.mapping_ = mapping;
+        return graph;
+    }
+
+    // Binary layout: binary_header_t, then (node_count + 1) offsets and
+    // entry_count targets, all as native-endian 32-bit unsigned integers.
+    void write_binary(const std::string& path) const
+    {
+        std::ofstream out(path, std::ios::binary);
+        if (!out.is_open()) {
+            throw std::runtime_error("Cannot create network file.");
+        }
+        binary_header_t header;
+        std::memcpy(header.magic, binary_magic(), binary_magic_size);
+        header.version = binary_version;
+        header.index_bytes = sizeof(node_t);
+        header.node_count = node_count_;
+        header.entry_count = entry_count();
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(offsets_), (node_count_ + 1) * sizeof(node_t));
+        out.write(reinterpret_cast<const char*>(targets_), entry_count() * sizeof(node_t));
+        if (!out) {
+            throw std::runtime_error("Cannot write network file.");
+        }
+    }
+
+    // Text layout: node count, then one 'v1 v2' line per edge with v1 < v2.
+    void write_text(const std::string& path) const
+    {
+        std::ofstream out(path);
+        if (!out.is_open()) {
+            throw std::runtime_error("Cannot create network file.");
+        }
+        out << node_count_ << std::endl;
+        for (std::size_t i = 0; i < node_count_; ++i) {
+            for (node_t j : neighbours(i)) {
+                if (i < j) {
+                    out << i << " " << j << "\n";
+                }
+            }
+        }
+        if (!out) {
+            throw std::runtime_error("Cannot write network file.");
+        }
+    }
+
+    // Copy of the graph in which node i is renamed to new_index[i]; new_index
+    // must be a permutation of the nodes.
+    csr_graph_t permuted(const std::vector<node_t>& new_index) const
+    {
+        if (new_index.size() != node_count_) {
+            throw std::runtime_error("Invalid node permutation.");
+        }
+        std::vector<node_t> old_index(node_count_, std::numeric_limits<node_t>::max());
+        for (std::size_t i = 0; i < node_count_; ++i) {
+            if (new_index[i] >= node_count_ || std::numeric_limits<node_t>::max() != old_index[new_index[i]]) {
+                throw std::runtime_error("Invalid node permutation.");
+            }
+            old_index[new_index[i]] = static_cast<node_t>(i);
+        }
+        csr_graph_t graph;
+        graph.node_count_ = node_count_;
+        graph.offsets_storage_.assign(node_count_ + 1, 0);
+        graph.targets_storage_.resize(entry_count());
+        for (std::size_t v = 0; v < node_count_; ++v) {
+            const node_t first = graph.offsets_storage_[v];
+            node_t out = first;
+            for (node_t j : neighbours(old_index[v])) {
+                graph.targets_storage_[out++] = new_index[j];
+            }
+            std::sort(graph.targets_storage_.begin() + first, graph.targets_storage_.begin() + out);
+            graph.offsets_storage_[v + 1] = out;
+        }
+        graph.offsets_ = graph.offsets_storage_.data();
+        graph.targets_ = graph.targets_storage_.data();
+        return graph;
+    }
+
+    std::size_t node_count() const { return node_count_; }
+
+    // Number of stored adjacency entries (twice the edge count).
+    std::size_t entry_count() const { return offsets_[node_count_]; }
+
+    std::size_t edge_count() const { return entry_count() / 2; }
+
+    std::size_t degree(std::size_t node) const { return offsets_[node + 1] - offsets_[node]; }
+
+    neighbour_range_t neighbours(std::size_t node) const
+    {
+        return neighbour_range_t(targets_ + offsets_[node], targets_ + offsets_[node + 1]);
+    }
+
+    const node_t* offsets() const { return offsets_; }
+    const node_t* targets() const { return targets_; }
+
+private:
+    struct binary_header_t
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t index_bytes;
+        std::uint64_t node_count;
+        std::uint64_t entry_count;
+    };
+
+    struct mapping_t
+    {
+        boost::interprocess::mapped_region region;
+    };
+
+    enum { binary_version = 1 };
+    static constexpr std::size_t binary_magic_size = 8;
+
+    static const char* binary_magic()
+    {
+        return "HMNCSR\0\0";
+    }
+
+    std::size_t node_count_;
+    const node_t* offsets_;
+    const node_t* targets_;
+    std::vector<node_t> offsets_storage_;
+    std::vector<node_t> targets_storage_;
+    std::shared_ptr<mapping_t> mapping_;
+};
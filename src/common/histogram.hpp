@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include "binary_io.hpp"
+
+// Binning of a value range: either linear bins of a fixed width starting at
+// an origin, or log-spaced bins with a fixed number of bins per decade
+// (positive values only).
+class histogram_binning_t
+{
+public:
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+    // Linear bins of the given width covering [min, max].
+    static histogram_binning_t linear(double min, double max, double width)
+    {
+        histogram_binning_t binning;
+        binning.origin_ = min;
+        binning.width_ = width;
+        binning.count_ = static_cast<std::size_t>(std::floor((max - min) / width)) + 1;
+        return binning;
+    }
+
+    // Log-spaced bins covering [min, max], min > 0. Bin edges are 10^(k / bins_per_decade).
+    static histogram_binning_t logarithmic(double min, double max, std::size_t bins_per_decade)
+    {
+        histogram_binning_t binning;
+        binning.logarithmic_ = true;
+        binning.bins_per_decade_ = static_cast<double>(bins_per_decade);
+        binning.origin_ = std::floor(std::log10(min) * binning.bins_per_decade_);
+        binning.count_ = static_cast<std::size_t>(std::floor(std::log10(max) * binning.bins_per_decade_) - binning.origin_) + 1;
+        return binning;
+    }
+
+    bool is_logarithmic() const
+    {
+        return logarithmic_;
+    }
+
+    std::size_t size() const
+    {
+        return count_;
+    }
+
+    // Bin of the value, or npos if it is outside the covered range.
+    std::size_t bin(double value) const
+    {
+        double position = logarithmic_ ? (value > 0. ? std::log10(value) * bins_per_decade_ - origin_ : -1.) : (value - origin_) / width_;
+        if (!(position >= 0.)) {
+            return npos;
+        }
+        std::size_t bin = static_cast<std::size_t>(position);
+        return bin < count_ ? bin : npos;
+    }
+
+    double lower(std::size_t bin) const
+    {
+        return logarithmic_ ? std::pow(10., (origin_ + bin) / bins_per_decade_) : origin_ + bin * width_;
+    }
+
+    double width(std::size_t bin) const
+    {
+        return lower(bin + 1) - lower(bin);
+    }
+
+    // Arithmetic center of linear bins, geometric center of log-spaced bins.
+    double center(std::size_t bin) const
+    {
+        return logarithmic_ ? std::pow(10., (origin_ + bin + 0.5) / bins_per_decade_) : origin_ + (bin + 0.5) * width_;
+    }
+
+private:
+    histogram_binning_t()
+        : logarithmic_(false)
+        , origin_(0.)
+        , width_(1.)
+        , bins_per_decade_(1.)
+        , count_(0)
+    {
+    }
+
+    bool logarithmic_;
+    double origin_; // first value (linear) or index of the first log bin
+    double width_;
+    double bins_per_decade_;
+    std::size_t count_;
+};
+
+// Counts of values per bin. Memory is O(bins); per-thread histograms are merged.
+class histogram_t
+{
+public:
+    explicit histogram_t(const histogram_binning_t& binning)
+        : binning_(binning)
+        , counts_(binning.size(), 0)
+        , outside_(0)
+    {
+    }
+
+    void add(double value)
+    {
+        std::size_t bin = binning_.bin(value);
+        if (histogram_binning_t::npos == bin) {
+            ++outside_;
+        } else {
+            ++counts_[bin];
+        }
+    }
+
+    void merge(const histogram_t& other)
+    {
+        for (std::size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        outside_ += other.outside_;
+    }
+
+    // Counts for checkpoints; the binning is not stored.
+    void save(binary_writer_t& out) const
+    {
+        out.write(counts_);
+        out.write(outside_);
+    }
+
+    void load(binary_reader_t& in)
+    {
+        in.read(counts_);
+        in.read(outside_);
+        if (counts_.size() != binning_.size()) {
+            throw std::runtime_error("Invalid checkpoint data.");
+        }
+    }
+
+    const histogram_binning_t& binning() const
+    {
+        return binning_;
+    }
+
+    std::uint64_t count(std::size_t bin) const
+    {
+        return counts_[bin];
+    }
+
+    // Values that fell outside the binned range.
+    std::uint64_t outside() const
+    {
+        return outside_;
+    }
+
+    std::uint64_t total() const
+    {
+        std::uint64_t total = outside_;
+        for (std::uint64_t c : counts_) {
+            total += c;
+        }
+        return total;
+    }
+
+    // Probability density of the bin: count / (bin width * all values).
+    double density(std::size_t bin) const
+    {
+        std::uint64_t n = total();
+        return n ? counts_[bin] / (binning_.width(bin) * n) : 0.;
+    }
+
+private:
+    histogram_binning_t binning_;
+    std::vector<std::uint64_t> counts_;
+    std::uint64_t outside_;
+};
+
+// Writes histograms sharing one binning as 'center count ...' lines: one
+// count column per histogram for linear bins, 'count density' column pairs
+// for log-spaced bins, where the bin widths differ.
+inline void write_histograms(std::ostream& out, const std::vector<histogram_t>& histograms)
+{
+    if (histograms.empty()) {
+        return;
+    }
+    const histogram_binning_t& binning = histograms.front().binning();
+    for (std::size_t i = 0; i < binning.size(); ++i) {
+        out << binning.center(i);
+        for (const histogram_t& h : histograms) {
+            out << " " << h.count(i);
+            if (binning.is_logarithmic()) {
+                out << " " << h.density(i);
+            }
+        }
+        out << "\n";
+    }
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <omp.h>
+
+#include "csr_graph.hpp"
+#include "random.hpp"
+
+// Hierarchical modular network (HMN) generator shared by hmn_generator and
+// the ensemble mode of the simulator.
+//
+// N = b^(S + 1) nodes form fully connected modules of M_0 nodes. At level
+// l = 1..S, blocks of b^l nodes are grouped b at a time, and every pair of
+// sibling blocks is connected by edges between each of its node pairs with
+// probability alpha * p^l, resampled until at least one edge exists.
+struct hmn_parameters_t
+{
+    std::size_t S;
+    std::size_t b;
+    std::size_t M0;
+    double p;
+    double alpha;
+
+    std::size_t node_count() const
+    {
+        return power(b, S + 1);
+    }
+
+    static std::size_t power(std::size_t base, std::size_t exponent)
+    {
+        if (0 == exponent) {
+            return 1;
+        }
+        if (0 == base) {
+            return 0;
+        }
+        std::size_t result = base;
+        while (--exponent != 0) {
+            result *= base;
+        }
+        return result;
+    }
+};
+
+struct hmn_level_t
+{
+    double p; // connection probability of a node pair
+    std::size_t block_count;
+    std::size_t block_size;
+};
+
+// Levels 1..S of the hierarchy.
+inline std::vector<hmn_level_t> hmn_levels(const hmn_parameters_t& parameters)
+{
+    const std::size_t N = parameters.node_count();
+    std::vector<hmn_level_t> levels;
+    for (std::size_t l = 1; l <= parameters.S; ++l) {
+        hmn_level_t level;
+        level.p = parameters.alpha * std::pow(parameters.p, l); // p^l from level 1 up, as generated networks always had
+        level.block_count = N / hmn_parameters_t::power(parameters.b, l);
+        level.block_size = N / level.block_count;
+        levels.push_back(level);
+    }
+    return levels;
+}
+
+// Adds the edges between two distinct blocks, where each of the block_size^2 node
+// pairs is connected independently with probability p. Instead of one coin flip per
+// pair, the gap to the next connected pair is drawn from the geometric distribution,
+// so the cost is proportional to the number of edges. Returns the number of edges added.
+template <class engine_t>
+std::size_t sample_block_pair(engine_t& gen, double p, std::size_t block1, std::size_t block2, std::size_t block_size, std::vector<csr_graph_t::edge_t>& edges)
+{
+    const std::size_t pair_count = block_size * block_size;
+    std::size_t added = 0;
+    if (p >= 1.0) {
+        for (std::size_t m = 0; m < pair_count; ++m) {
+            edges.emplace_back(block1 * block_size + m / block_size, block2 * block_size + m % block_size);
+        }
+        return pair_count;
+    }
+    const double log_q = std::log1p(-p);
+    for (std::size_t m = 0; m < pair_count; ++m) {
+        // number of unconnected pairs before the next connected one
+        double skip = std::floor(std::log1p(-uniform_real(gen)) / log_q);
+        if (skip >= static_cast<double>(pair_count - m)) {
+            break;
+        }
+        m += static_cast<std::size_t>(skip);
+        edges.emplace_back(block1 * block_size + m / block_size, block2 * block_size + m % block_size);
+        ++added;
+    }
+    return added;
+}
+
+// Generates one HMN realization. Every pair of sibling blocks draws from its own
+// random stream, so the network depends only on the seed, not on the thread count.
+inline csr_graph_t generate_hmn(const hmn_parameters_t& parameters, std::uint64_t seed)
+{
+    const std::size_t N = parameters.node_count();
+    const std::size_t M0 = parameters.M0;
+    if (0 == parameters.b || 0 == M0) {
+        throw std::runtime_error("Invalid network parameters.");
+    }
+
+    // one edge buffer per thread plus one for the modules; all of them are merged by the CSR builder
+    std::vector<std::vector<csr_graph_t::edge_t> > edges(omp_get_max_threads() + 1);
+
+    // step 1: generation of the fully connected blocks
+    // N/M0 the count of blocks at the 0 level
+    std::vector<csr_graph_t::edge_t>& module_edges = edges.back();
+    for (std::size_t i = 0; i < N / M0; i++) {
+        for (std::size_t j = i * M0; j < (i + 1) * M0; j++) {
+            for (std::size_t k = j + 1; k < (i + 1) * M0; k++) {
+                module_edges.emplace_back(j, k);
+            }
+        }
+    }
+
+    // step 2: collect the sibling block pairs of every level
+    struct block_pair_t
+    {
+        std::size_t level;
+        std::size_t block1;
+        std::size_t block2;
+        std::size_t block_size;
+        double p;
+    };
+    std::vector<block_pair_t> block_pairs;
+    const std::vector<hmn_level_t> levels = hmn_levels(parameters);
+    for (std::size_t l = 1; l <= levels.size(); ++l) {
+        const hmn_level_t& level = levels[l - 1];
+        if (level.p <= 0.) {
+            throw std::runtime_error("Invalid connection probability at level " + std::to_string(l) + ".");
+        }
+        for (std::size_t current_b = 0; current_b < level.block_count; current_b += parameters.b) {
+            for (std::size_t block1 = current_b; block1 < current_b + parameters.b; ++block1) {
+                for (std::size_t block2 = block1 + 1; block2 < current_b + parameters.b; ++block2) {
+                    block_pairs.push_back(block_pair_t{ l, block1, block2, level.block_size, level.p });
+                }
+            }
+        }
+    }
+
+    // step 3: link the block pairs independently, each with its own random stream
+#pragma omp parallel for schedule(dynamic, 64)
+    for (std::size_t i = 0; i < block_pairs.size(); ++i) {
+        const block_pair_t& pair = block_pairs[i];
+        xoshiro256pp_t gen(seed, hash_combine(hash_combine(pair.level, pair.block1), pair.block2));
+        std::vector<csr_graph_t::edge_t>& thread_edges = edges[omp_get_thread_num()];
+        // sibling blocks must be connected by at least one edge: resample until they are
+        while (0 == sample_block_pair(gen, pair.p, pair.block1, pair.block2, pair.block_size, thread_edges)) {
+        }
+    }
+
+    return csr_graph_t::from_edge_buffers(N, edges.data(), edges.data() + edges.size());
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glob.h>
+#include <omp.h>
+
+// Batch input of the analysis tools. Every argument is a file name or a glob
+// pattern ('*', '?', '[...]'); an argument '@list' names a text file with one
+// file name or pattern per line. Patterns expand in sorted order, and a pattern
+// that matches no file is an error, so a typo does not silently shrink a batch.
+inline std::vector<std::string> expand_input_files(const std::vector<std::string>& arguments)
+{
+    std::vector<std::string> files;
+    for (const std::string& argument : arguments) {
+        std::vector<std::string> patterns;
+        if (!argument.empty() && '@' == argument[0]) {
+            std::ifstream list(argument.substr(1));
+            if (!list.is_open()) {
+                throw std::runtime_error("Cannot open input list " + argument.substr(1) + ".");
+            }
+            for (std::string line; std::getline(list, line);) {
+                while (!line.empty() && ('\r' == line.back() || ' ' == line.back() || '\t' == line.back())) {
+                    line.pop_back();
+                }
+                if (!line.empty()) {
+                    patterns.emplace_back(line);
+                }
+            }
+        } else {
+            patterns.emplace_back(argument);
+        }
+        for (const std::string& pattern : patterns) {
+            if (std::string::npos == pattern.find_first_of("*?[")) {
+                files.emplace_back(pattern);
+                continue;
+            }
+            glob_t matches;
+            const int status = glob(pattern.c_str(), 0, nullptr, &matches);
+            if (0 == status) {
+                files.insert(files.end(), matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+            }
+            globfree(&matches);
+            if (0 != status) {
+                throw std::runtime_error("No input file matches " + pattern + ".");
+            }
+        }
+    }
+    return files;
+}
+
+// Output file of one input in a batch: <folder>/<input name without extension><suffix>.
+inline std::string per_file_output_path(const std::string& folder, const std::string& input, const std::string& suffix)
+{
+    std::string name = input.substr(input.find_last_of('/') + 1);
+    const std::size_t dot = name.find_last_of('.');
+    if (std::string::npos != dot && 0 != dot) {
+        name.erase(dot);
+    }
+    return (folder.empty() ? std::string(".") : folder) + "/" + name + suffix;
+}
+
+// Calls process(i) for the files [first, last) of a batch on the OpenMP threads,
+// one file per thread at a time and dynamically scheduled, so a batch of many
+// small files is not limited by their sizes differing. Once all of them are
+// done, the first error in file order is rethrown with the file name.
+template <class process_t>
+void parallel_for_files(const std::vector<std::string>& files, std::size_t first, std::size_t last, process_t&& process)
+{
+    std::vector<std::exception_ptr> errors(last - first);
+#pragma omp parallel for schedule(dynamic)
+    for (std::size_t i = first; i < last; ++i) {
+        try {
+            process(i);
+        } catch (...) {
+            errors[i - first] = std::current_exception();
+        }
+    }
+    for (std::size_t i = first; i < last; ++i) {
+        if (errors[i - first]) {
+            try {
+                std::rethrow_exception(errors[i - first]);
+            } catch (std::exception& e) {
+                throw std::runtime_error(files[i] + ": " + e.what());
+            }
+        }
+    }
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "csr_graph.hpp"
+
+// Node renumbering for memory locality. Simulations touch the states of a
+// node's neighbours on every propagation; numbering nodes so that neighbours
+// get close indices keeps those accesses within few cache lines.
+//
+// A node_permutation_t maps the node ids of the input network ("original")
+// to the ids used internally and back.
+class node_permutation_t
+{
+public:
+    // Identity on node_count nodes.
+    explicit node_permutation_t(std::size_t node_count = 0)
+        : new_index_(node_count)
+        , original_index_(node_count)
+    {
+        std::iota(new_index_.begin(), new_index_.end(), node_t(0));
+        std::iota(original_index_.begin(), original_index_.end(), node_t(0));
+    }
+
+    // order[k] is the original id of the node that gets internal id k.
+    static node_permutation_t from_order(const std::vector<node_t>& order)
+    {
+        node_permutation_t permutation;
+        permutation.original_index_ = order;
+        permutation.new_index_.assign(order.size(), std::numeric_limits<node_t>::max());
+        for (std::size_t k = 0; k < order.size(); ++k) {
+            if (order[k] >= order.size() || std::numeric_limits<node_t>::max() != permutation.new_index_[order[k]]) {
+                throw std::runtime_error("Invalid node order.");
+            }
+            permutation.new_index_[order[k]] = static_cast<node_t>(k);
+        }
+        return permutation;
+    }
+
+    node_t to_internal(node_t original) const
+    {
+        return new_index_[original];
+    }
+
+    node_t to_original(node_t internal) const
+    {
+        return original_index_[internal];
+    }
+
+    // original_index()[internal] == to_original(internal).
+    const std::vector<node_t>& original_index() const
+    {
+        return original_index_;
+    }
+
+    // Argument of csr_graph_t::permuted().
+    const std::vector<node_t>& new_index() const
+    {
+        return new_index_;
+    }
+
+private:
+    std::vector<node_t> new_index_;
+    std::vector<node_t> original_index_;
+};
+
+namespace node_ordering_detail
+{
+struct search_result_t
+{
+    std::size_t last_level; // index in the queue where the last level begins
+    std::size_t depth; // number of levels after the start
+};
+
+// Breadth-first search from start over nodes not yet numbered. Appends the
+// visited nodes to queue in BFS order, neighbours of a node by increasing
+// degree, and marks them in 'numbered'.
+inline search_result_t cuthill_mckee_search(const csr_graph_t& graph, node_t start, std::vector<char>& numbered, std::vector<node_t>& queue)
+{
+    const std::size_t first = queue.size();
+    std::size_t level_begin = first;
+    std::size_t level_end = first + 1;
+    std::size_t depth = 0;
+    queue.push_back(start);
+    numbered[start] = 1;
+    for (std::size_t head = first; head < queue.size(); ++head) {
+        if (head == level_end) {
+            level_begin = level_end;
+            level_end = queue.size();
+            ++depth;
+        }
+        const std::size_t added = queue.size();
+        for (node_t j : graph.neighbours(queue[head])) {
+            if (!numbered[j]) {
+                numbered[j] = 1;
+                queue.push_back(j);
+            }
+        }
+        std::stable_sort(queue.begin() + added, queue.end(), [&](node_t a, node_t b) { return graph.degree(a) < graph.degree(b); });
+    }
+    return search_result_t{ level_begin, depth };
+}
+}
+
+// Reverse Cuthill-McKee order: every connected component is numbered in BFS
+// order from a pseudo-peripheral node (found by repeated searches from the
+// lowest degree node of the farthest level, as in George and Liu), and the
+// whole order is reversed. Returns order[k] = original id of internal node k.
+inline std::vector<node_t> reverse_cuthill_mckee_order(const csr_graph_t& graph)
+{
+    using node_ordering_detail::cuthill_mckee_search;
+    const std::size_t n = graph.node_count();
+    std::vector<node_t> by_degree(n);
+    std::iota(by_degree.begin(), by_degree.end(), node_t(0));
+    std::stable_sort(by_degree.begin(), by_degree.end(), [&](node_t a, node_t b) { return graph.degree(a) < graph.degree(b); });
+
+    std::vector<char> numbered(n, 0);
+    std::vector<char> probe_numbered(n, 0);
+    std::vector<node_t> order;
+    std::vector<node_t> probe;
+    order.reserve(n);
+    for (node_t start : by_degree) {
+        if (numbered[start]) {
+            continue;
+        }
+        // move the start to a pseudo-peripheral node of its component
+        std::size_t depth = 0;
+        for (std::size_t round = 0; round < 8; ++round) {
+            probe.clear();
+            node_ordering_detail::search_result_t search = cuthill_mckee_search(graph, start, probe_numbered, probe);
+            for (node_t v : probe) {
+                probe_numbered[v] = 0;
+            }
+            if (round > 0 && search.depth <= depth) {
+                break;
+            }
+            depth = search.depth;
+            start = *std::min_element(probe.begin() + search.last_level, probe.end(), [&](node_t a, node_t b) { return graph.degree(a) < graph.degree(b); });
+        }
+        cuthill_mckee_search(graph, start, numbered, order);
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+// Order selected by name: 'none' keeps the input numbering, 'rcm' is reverse_cuthill_mckee_order().
+inline node_permutation_t make_node_permutation(const csr_graph_t& graph, const std::string& ordering)
+{
+    if (ordering == "none") {
+        return node_permutation_t(graph.node_count());
+    }
+    if (ordering == "rcm") {
+        return node_permutation_t::from_order(reverse_cuthill_mckee_order(graph));
+    }
+    throw std::runtime_error("Invalid node ordering.");
+}
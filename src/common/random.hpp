@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <random>
+
+// splitmix64 finalizer, used to turn (seed, stream) keys into well mixed generator states.
+inline std::uint64_t splitmix64(std::uint64_t& state)
+{
+    std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Combines a key with a value into a new key, e.g. to derive a stream id from (lambda, repetition).
+inline std::uint64_t hash_combine(std::uint64_t key, std::uint64_t value)
+{
+    std::uint64_t state = key ^ (value + 0x9e3779b97f4a7c15ULL + (key << 6) + (key >> 2));
+    return splitmix64(state);
+}
+
+inline std::uint64_t hash_double(double value)
+{
+    std::uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return hash_combine(0, bits);
+}
+
+// xoshiro256++ by Blackman and Vigna: 256 bits of state, period 2^256 - 1,
+// a few cycles per 64-bit output. Satisfies UniformRandomBitGenerator.
+class xoshiro256pp_t
+{
+public:
+    typedef std::uint64_t result_type;
+
+    // Independent stream 'stream' of the run seeded with 'seed'.
+    xoshiro256pp_t(std::uint64_t seed, std::uint64_t stream)
+    {
+        std::uint64_t state = hash_combine(seed, stream);
+        for (std::uint64_t& word : s_) {
+            word = splitmix64(state);
+        }
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()()
+    {
+        const std::uint64_t result = rotl(s_[0] + s_[3], 23) + s_[0];
+        const std::uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return result;
+    }
+
+    // Textual state, like the standard engines, e.g. for checkpoints.
+    friend std::ostream& operator<<(std::ostream& out, const xoshiro256pp_t& gen)
+    {
+        return out << gen.s_[0] << " " << gen.s_[1] << " " << gen.s_[2] << " " << gen.s_[3];
+    }
+
+    friend std::istream& operator>>(std::istream& in, xoshiro256pp_t& gen)
+    {
+        return in >> gen.s_[0] >> gen.s_[1] >> gen.s_[2] >> gen.s_[3];
+    }
+
+private:
+    static std::uint64_t rotl(std::uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    std::uint64_t s_[4];
+};
+
+// Creates stream 'stream' of an arbitrary standard engine (e.g. std::mt19937_64).
+template <class engine_t>
+struct stream_factory_t
+{
+    static engine_t make(std::uint64_t seed, std::uint64_t stream)
+    {
+        std::uint64_t state = hash_combine(seed, stream);
+        std::uint32_t words[8];
+        for (std::size_t i = 0; i < 8; i += 2) {
+            std::uint64_t word = splitmix64(state);
+            words[i] = static_cast<std::uint32_t>(word);
+            words[i + 1] = static_cast<std::uint32_t>(word >> 32);
+        }
+        std::seed_seq seq(words, words + 8);
+        return engine_t(seq);
+    }
+};
+
+template <>
+struct stream_factory_t<xoshiro256pp_t>
+{
+    static xoshiro256pp_t make(std::uint64_t seed, std::uint64_t stream)
+    {
+        return xoshiro256pp_t(seed, stream);
+    }
+};
+
+template <class engine_t>
+engine_t make_stream(std::uint64_t seed, std::uint64_t stream)
+{
+    return stream_factory_t<engine_t>::make(seed, stream);
+}
+
+// The helpers below replace the std:: distributions in hot loops. They
+// expect an engine producing 64 uniformly random bits per call.
+
+// Uniform double in [0, 1).
+template <class engine_t>
+inline double uniform_real(engine_t& gen)
+{
+    static_assert(engine_t::max() == std::numeric_limits<std::uint64_t>::max(), "64-bit engine required");
+    return (gen() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Uniform integer in [0, n), n > 0 (Lemire's multiply-and-reject method).
+template <class engine_t>
+inline std::uint64_t uniform_index(engine_t& gen, std::uint64_t n)
+{
+    static_assert(engine_t::max() == std::numeric_limits<std::uint64_t>::max(), "64-bit engine required");
+    unsigned __int128 m = static_cast<unsigned __int128>(gen()) * n;
+    std::uint64_t low = static_cast<std::uint64_t>(m);
+    if (low < n) {
+        const std::uint64_t threshold = (0 - n) % n;
+        while (low < threshold) {
+            m = static_cast<unsigned __int128>(gen()) * n;
+            low = static_cast<std::uint64_t>(m);
+        }
+    }
+    return static_cast<std::uint64_t>(m >> 64);
+}
+
+// Exponentially distributed value with unit rate.
+template <class engine_t>
+inline double exponential(engine_t& gen)
+{
+    return -std::log1p(-uniform_real(gen));
+}
+
+// Bernoulli trial with a precomputed integer threshold: one engine call and
+// one comparison per draw.
+class bernoulli_t
+{
+public:
+    explicit bernoulli_t(double p)
+        : always_(p >= 1.0)
+        , threshold_(p <= 0.0 || p >= 1.0 ? 0 : static_cast<std::uint64_t>(std::ldexp(p, 64)))
+    {
+    }
+
+    template <class engine_t>
+    bool operator()(engine_t& gen) const
+    {
+        return always_ || gen() < threshold_;
+    }
+
+private:
+    bool always_;
+    std::uint64_t threshold_;
+};
+
+// 64 independent Bernoulli trials at once, one per bit, for bit-parallel
+// replicas. Every bit compares its own uniform binary fraction, drawn one
+// digit per engine call, with the binary digits of p; a bit stops drawing as
+// soon as the digits differ, so about log2(64) + 2 calls are needed.
+class bernoulli_mask_t
+{
+public:
+    explicit bernoulli_mask_t(double p)
+        : always_(p >= 1.0)
+        , threshold_(p <= 0.0 || p >= 1.0 ? 0 : static_cast<std::uint64_t>(std::ldexp(p, 64)))
+    {
+    }
+
+    template <class engine_t>
+    std::uint64_t operator()(engine_t& gen) const
+    {
+        static_assert(engine_t::max() == std::numeric_limits<std::uint64_t>::max(), "64-bit engine required");
+        if (always_) {
+            return ~std::uint64_t(0);
+        }
+        std::uint64_t result = 0;
+        std::uint64_t undecided = ~std::uint64_t(0);
+        for (int digit = 63; digit >= 0 && undecided; --digit) {
+            const std::uint64_t random = gen();
+            if ((threshold_ >> digit) & 1) {
+                // a 0 digit of the fraction where p has a 1: the fraction is below p
+                result |= undecided & ~random;
+                undecided &= random;
+            } else {
+                undecided &= ~random;
+            }
+        }
+        return result;
+    }
+
+private:
+    bool always_;
+    std::uint64_t threshold_;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Binary trajectory of one repetition.
+//
+// The file starts with trajectory_header_t. Each record holds the number of
+// active nodes as a zigzag LEB128 varint of the difference to the previous
+// record; most steps change it by at most a few nodes, so a record is usually
+// one byte. Discrete trajectories have implicit times 0, 1, 2, ...; in
+// continuous time trajectories every record is preceded by its time as a
+// native-endian double.
+struct trajectory_header_t
+{
+    enum time_kind_t : std::uint32_t
+    {
+        steps = 0,
+        continuous = 1
+    };
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t time_kind;
+    std::uint64_t node_count;
+    double lambda;
+    double mu;
+    char model[8];
+    std::uint64_t seed;
+    std::uint64_t repetition;
+
+    static const char* expected_magic()
+    {
+        return "HMNTRJ\0\0";
+    }
+
+    static trajectory_header_t make(time_kind_t time_kind, std::uint64_t node_count, double lambda, double mu, const std::string& model, std::uint64_t seed, std::uint64_t repetition)
+    {
+        trajectory_header_t header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, expected_magic(), sizeof(header.magic));
+        header.version = 1;
+        header.time_kind = time_kind;
+        header.node_count = node_count;
+        header.lambda = lambda;
+        header.mu = mu;
+        std::strncpy(header.model, model.c_str(), sizeof(header.model) - 1);
+        header.seed = seed;
+        header.repetition = repetition;
+        return header;
+    }
+};
+
+inline void append_varint(std::vector<char>& out, std::int64_t value)
+{
+    std::uint64_t zigzag = (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+    while (zigzag >= 0x80) {
+        out.push_back(static_cast<char>((zigzag & 0x7f) | 0x80));
+        zigzag >>= 7;
+    }
+    out.push_back(static_cast<char>(zigzag));
+}
+
+// Sequential reader of a binary trajectory file.
+class trajectory_reader_t
+{
+public:
+    explicit trajectory_reader_t(const std::string& path)
+        : in_(path, std::ios::binary)
+        , index_(0)
+        , count_(0)
+    {
+        if (!in_.is_open()) {
+            throw std::runtime_error("Cannot open trajectory file.");
+        }
+        in_.read(reinterpret_cast<char*>(&header_), sizeof(header_));
+        if (!in_ || 0 != std::memcmp(header_.magic, trajectory_header_t::expected_magic(), sizeof(header_.magic)) || 1 != header_.version) {
+            throw std::runtime_error("Invalid trajectory file.");
+        }
+    }
+
+    const trajectory_header_t& header() const
+    {
+        return header_;
+    }
+
+    // Reads the next record; returns false at the end of the file.
+    bool next(double& time, std::uint64_t& active_count)
+    {
+        if (trajectory_header_t::continuous == header_.time_kind) {
+            if (!in_.read(reinterpret_cast<char*>(&time), sizeof(time))) {
+                return false;
+            }
+        } else {
+            time = static_cast<double>(index_);
+        }
+        std::uint64_t zigzag = 0;
+        int shift = 0;
+        for (;;) {
+            int c = in_.get();
+            if (std::char_traits<char>::eof() == c) {
+                if (0 != shift || trajectory_header_t::continuous == header_.time_kind) {
+                    throw std::runtime_error("Truncated trajectory file.");
+                }
+                return false;
+            }
+            zigzag |= static_cast<std::uint64_t>(c & 0x7f) << shift;
+            if (0 == (c & 0x80)) {
+                break;
+            }
+            shift += 7;
+        }
+        std::int64_t delta = static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1);
+        count_ = static_cast<std::uint64_t>(static_cast<std::int64_t>(count_) + delta);
+        active_count = count_;
+        ++index_;
+        return true;
+    }
+
+private:
+    std::ifstream in_;
+    trajectory_header_t header_;
+    std::uint64_t index_;
+    std::uint64_t count_;
+};
@@ -1,115 +1,264 @@
-#include <fstream>
-#include <vector>
-#include <string>
-#include <algorithm>
-#include <iostream>
-#include <regex>
-
-#include <boost/program_options.hpp>
-
-namespace po = boost::program_options;
-
-std::vector<std::string> split(const std::string& input, const std::string& regex)
-{
-	// passing -1 as the submatch index parameter performs splitting
-	std::regex re(regex);
-	std::sregex_token_iterator
-		 first{input.begin(), input.end(), re, -1},
-		 last;
-	return {first, last};
-}
-
-int main(int argc, char **argv)
-{
-	std::string input_file_name;
-	long double epsilon;
-	std::string output_file_name;
-	std::size_t column;
-	std::size_t start_row;
-	po::options_description desc("Program options");
-	desc.add_options()("help", "Produce help message")(
-		"input", po::value<std::string>(&input_file_name)->required(), "Input file name.")(
-		"column", po::value<std::size_t>(&column)->default_value(1), "Column number in input file (1-based).")(
-		"start_row", po::value<std::size_t>(&start_row)->default_value(1), "Start row in input file (1-based).")(
-		"bin", po::value<long double>(&epsilon)->required(), "Bin width.")(
-		"output", po::value<std::string>(&output_file_name)->required(), "Output file name.");
-
-	po::variables_map vm;
-	try
-	{
-		po::store(po::parse_command_line(argc, argv, desc), vm);
-		po::notify(vm);
-	}
-	catch (po::error &e)
-	{
-		std::cerr << "\nError parsing command line: " << e.what() << std::endl
-					 << std::endl;
-		std::cerr << desc << std::endl;
-		return false;
-	}
-
-	if (vm.count("help"))
-	{
-		std::cout << desc << std::endl;
-		return 1;
-	}
-
-	std::ifstream in(input_file_name);
-	if (!in.is_open())
-	{
-		std::cerr << "Cannot open input file." << std::endl;
-		return -1;
-	}
-	std::vector<long double> values;
-	std::string line;
-	std::size_t lines_read = 0;
-	while (std::getline(in, line))
-	{
-		const std::vector<std::string>& tokens = split(line, "\\s");
-		if(tokens.size() >= column)
-		{
-			if(++lines_read > start_row)
-			{
-				long double val = std::stold(tokens[column-1]);
-				values.push_back(val);
-			}
-		}
-		else
-		{
-			std::cerr << "Invalid input data: one of the lines does not contain enough columns." << std::endl;
-			in.close();
-			return -1;
-		}
-	}
-	in.close();
-	if(values.empty())
-	{
-		return -1;
-	}
-	std::vector<std::size_t> density;
-	std::sort(values.begin(), values.end());
-	std::size_t k = 0;
-	long double current_start = values[0];
-	for (std::size_t j = 0; j < values.size();)
-	{
-		density.emplace_back(0);
-		while(j < values.size() && values[j++] < current_start + epsilon)
-		{
-			++density[k];
-		}
-		k++;
-		current_start += epsilon;
-	}
-	std::ofstream out(output_file_name);
-	if (!out.is_open())
-	{
-		std::cerr << "Invalid output file." << std::endl;
-		return -1;
-	}
-	for (std::size_t i = 0; i < density.size(); ++i)
-	{
-		out << i*epsilon + epsilon/2 << " " << density[i] << std::endl;
-	}
-	out.close();
-	return 0;
-}
\ No newline at end of file
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <set>
+
+#include <boost/program_options.hpp>
+
+#include <omp.h>
+
+#include "column_reader.hpp"
+#include "histogram.hpp"
+#include "input_files.hpp"
+
+namespace po = boost::program_options;
+
+// Smallest and largest value of one chunk; for log-spaced bins only positive values count.
+struct range_visitor_t
+{
+	explicit range_visitor_t(std::size_t columns = 0, bool positive_only = false)
+		: columns(columns)
+		, positive_only(positive_only)
+		, min(std::numeric_limits<double>::infinity())
+		, max(-std::numeric_limits<double>::infinity())
+	{
+	}
+
+	void operator()(const long double *values)
+	{
+		for (std::size_t k = 0; k < columns; ++k)
+		{
+			const double value = static_cast<double>(values[k]);
+			if (positive_only && !(value > 0.))
+			{
+				continue;
+			}
+			min = std::min(min, value);
+			max = std::max(max, value);
+		}
+	}
+
+	std::size_t columns;
+	bool positive_only;
+	double min;
+	double max;
+};
+
+// Per-chunk histograms, one for each requested column.
+struct histogram_visitor_t
+{
+	histogram_visitor_t(std::size_t columns, const histogram_binning_t &binning)
+		: histograms(columns, histogram_t(binning))
+	{
+	}
+
+	void operator()(const long double *values)
+	{
+		for (std::size_t k = 0; k < histograms.size(); ++k)
+		{
+			histograms[k].add(static_cast<double>(values[k]));
+		}
+	}
+
+	std::vector<histogram_t> histograms;
+};
+
+int main(int argc, char **argv)
+{
+	std::vector<std::string> inputs;
+	double epsilon;
+	std::size_t bins_per_decade;
+	std::string output_file_name;
+	std::string per_file_folder;
+	std::vector<std::size_t> columns;
+	std::size_t start_row;
+	double min_value;
+	double max_value;
+	po::options_description desc("Program options");
+	desc.add_options()("help", "Produce help message")(
+		"input", po::value<std::vector<std::string> >(&inputs)->required()->multitoken(), "Input file names, glob patterns or @list files with one name or pattern per line; values of all files are pooled. Files are processed concurrently when there are at least as many as threads.")(
+		"column", po::value<std::vector<std::size_t> >(&columns)->default_value(std::vector<std::size_t>(1, 1), "1")->multitoken(), "Column numbers in input files (1-based); one histogram per column.")(
+		"start_row", po::value<std::size_t>(&start_row)->default_value(1), "Start row in input files (1-based).")(
+		"bin", po::value<double>(&epsilon)->default_value(0.), "Bin width of linear bins.")(
+		"log_bins", po::value<std::size_t>(&bins_per_decade)->default_value(0), "Use log-spaced bins with this many bins per decade instead of linear ones (positive values only).")(
+		"min", po::value<double>(&min_value), "Lower bound of the binned range. Determined by an extra pass over the input if not set.")(
+		"max", po::value<double>(&max_value), "Upper bound of the binned range. Determined by an extra pass over the input if not set.")(
+		"per_file_output", po::value<std::string>(&per_file_folder), "Folder for the histograms of every input file, written to <input name>_histogram.txt with the binning of the pooled one.")(
+		"output", po::value<std::string>(&output_file_name)->required(), "Output file name of the pooled histograms.");
+
+	po::variables_map vm;
+	try
+	{
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+	}
+	catch (po::error &e)
+	{
+		std::cerr << "\nError parsing command line: " << e.what() << std::endl
+					 << std::endl;
+		std::cerr << desc << std::endl;
+		return false;
+	}
+
+	if (vm.count("help"))
+	{
+		std::cout << desc << std::endl;
+		return 1;
+	}
+
+	const bool logarithmic = bins_per_decade > 0;
+	if (!logarithmic && !(epsilon > 0.))
+	{
+		std::cerr << "Either a positive bin width or log_bins must be given." << std::endl;
+		return -1;
+	}
+
+	std::vector<std::string> input_file_names;
+	try
+	{
+		input_file_names = expand_input_files(inputs);
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+	const bool per_file = vm.count("per_file_output") > 0;
+	if (per_file)
+	{
+		std::set<std::string> names;
+		for (const std::string &name : input_file_names)
+		{
+			if (!names.insert(per_file_output_path(per_file_folder, name, "")).second)
+			{
+				std::cerr << "Several input files named " << name << "." << std::endl;
+				return -1;
+			}
+		}
+	}
+
+	// Few large files are split into chunks parsed in parallel; a batch of at least as
+	// many files as threads is processed one file per thread, each in one chunk. Counts,
+	// minima and maxima do not depend on the order, so both give the same histograms.
+	const std::size_t thread_count = static_cast<std::size_t>(omp_get_max_threads());
+	const bool file_parallel = input_file_names.size() >= thread_count && thread_count > 1;
+	const std::size_t chunk_count = file_parallel ? 1 : thread_count;
+
+	std::vector<histogram_t> histograms;
+	try
+	{
+		// the range pass only touches the mapped files, no values are kept
+		if (!vm.count("min") || !vm.count("max"))
+		{
+			std::vector<range_visitor_t> ranges(file_parallel ? input_file_names.size() : 0, range_visitor_t(columns.size(), logarithmic));
+			parallel_for_files(input_file_names, 0, file_parallel ? input_file_names.size() : 0, [&](std::size_t i) {
+				std::vector<range_visitor_t> visitors(1, range_visitor_t(columns.size(), logarithmic));
+				column_reader_t(input_file_names[i]).parallel_for_each(columns, start_row, visitors);
+				ranges[i] = visitors.front();
+			});
+			range_visitor_t range(columns.size(), logarithmic);
+			const auto merge_ranges = [&](const std::vector<range_visitor_t> &visitors) {
+				for (const range_visitor_t &v : visitors)
+				{
+					range.min = std::min(range.min, v.min);
+					range.max = std::max(range.max, v.max);
+				}
+			};
+			merge_ranges(ranges);
+			for (std::size_t i = 0; !file_parallel && i < input_file_names.size(); ++i)
+			{
+				std::vector<range_visitor_t> visitors(chunk_count, range_visitor_t(columns.size(), logarithmic));
+				column_reader_t(input_file_names[i]).parallel_for_each(columns, start_row, visitors);
+				merge_ranges(visitors);
+			}
+			if (range.min > range.max)
+			{
+				std::cerr << "No values to bin." << std::endl;
+				return -1;
+			}
+			if (!vm.count("min"))
+			{
+				min_value = range.min;
+			}
+			if (!vm.count("max"))
+			{
+				max_value = range.max;
+			}
+		}
+		if (min_value > max_value || (logarithmic && !(min_value > 0.)))
+		{
+			std::cerr << "Invalid histogram range." << std::endl;
+			return -1;
+		}
+
+		const histogram_binning_t binning = logarithmic ? histogram_binning_t::logarithmic(min_value, max_value, bins_per_decade)
+													: histogram_binning_t::linear(min_value, max_value, epsilon);
+		histograms.assign(columns.size(), histogram_t(binning));
+		// per-thread sums of the files processed concurrently
+		std::vector<histogram_visitor_t> thread_histograms(file_parallel ? thread_count : 0, histogram_visitor_t(columns.size(), binning));
+		const auto merge_histograms = [](std::vector<histogram_t> &sums, const std::vector<histogram_visitor_t> &visitors) {
+			for (const histogram_visitor_t &v : visitors)
+			{
+				for (std::size_t k = 0; k < sums.size(); ++k)
+				{
+					sums[k].merge(v.histograms[k]);
+				}
+			}
+		};
+		const auto write_per_file = [&](std::size_t i, const std::vector<histogram_visitor_t> &visitors) {
+			std::vector<histogram_t> file_histograms(columns.size(), histogram_t(binning));
+			merge_histograms(file_histograms, visitors);
+			std::ofstream out(per_file_output_path(per_file_folder, input_file_names[i], "_histogram.txt"));
+			if (!out.is_open())
+			{
+				throw std::runtime_error("Invalid output file.");
+			}
+			write_histograms(out, file_histograms);
+		};
+		parallel_for_files(input_file_names, 0, file_parallel ? input_file_names.size() : 0, [&](std::size_t i) {
+			std::vector<histogram_visitor_t> visitors(1, histogram_visitor_t(columns.size(), binning));
+			column_reader_t(input_file_names[i]).parallel_for_each(columns, start_row, visitors);
+			if (per_file)
+			{
+				write_per_file(i, visitors);
+			}
+			merge_histograms(thread_histograms[omp_get_thread_num()].histograms, visitors);
+		});
+		merge_histograms(histograms, thread_histograms);
+		for (std::size_t i = 0; !file_parallel && i < input_file_names.size(); ++i)
+		{
+			std::vector<histogram_visitor_t> visitors(chunk_count, histogram_visitor_t(columns.size(), binning));
+			column_reader_t(input_file_names[i]).parallel_for_each(columns, start_row, visitors);
+			if (per_file)
+			{
+				write_per_file(i, visitors);
+			}
+			merge_histograms(histograms, visitors);
+		}
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+	for (std::size_t k = 0; k < histograms.size(); ++k)
+	{
+		if (histograms[k].outside() > 0)
+		{
+			std::cerr << "column " << columns[k] << ": " << histograms[k].outside() << " values outside of the binned range" << std::endl;
+		}
+	}
+
+	std::ofstream out(output_file_name);
+	if (!out.is_open())
+	{
+		std::cerr << "Invalid output file." << std::endl;
+		return -1;
+	}
+	write_histograms(out, histograms);
+	out.close();
+	return 0;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/dynamic_bitset.hpp>
+
+#include "binary_io.hpp"
+#include "csr_graph.hpp"
+#include "node_activity.hpp"
+#include "random.hpp"
+
+// Set of active nodes with O(1) insertion, removal and uniform sampling.
+// Active nodes are kept in a dense array; position_[i] is the index of node i
+// in that array (or npos if node i is inactive). The passive bitset keeps the
+// original convention: passive_[i] == true means node i is inactive.
+// The set also remembers which nodes have ever been active, and reports
+// activations and deactivations to a node_activity_t if one is attached.
+class active_set_t
+{
+public:
+    static constexpr node_t npos = std::numeric_limits<node_t>::max();
+
+    explicit active_set_t(const boost::dynamic_bitset<>& states)
+        : passive_(states)
+        , ever_active_(~states)
+        , position_(states.size(), npos)
+        , activity_(nullptr)
+    {
+        nodes_.reserve(states.size());
+        for (std::size_t i = 0; i < states.size(); ++i) {
+            if (!states[i]) {
+                position_[i] = static_cast<node_t>(nodes_.size());
+                nodes_.emplace_back(i);
+            }
+        }
+    }
+
+    bool is_active(node_t node) const
+    {
+        return !passive_[node];
+    }
+
+    void activate(node_t node)
+    {
+        if (!passive_[node]) {
+            return;
+        }
+        passive_[node] = false;
+        ever_active_[node] = true;
+        position_[node] = static_cast<node_t>(nodes_.size());
+        nodes_.emplace_back(node);
+        if (activity_) {
+            activity_->activated(node);
+        }
+    }
+
+    void deactivate(node_t node)
+    {
+        if (passive_[node]) {
+            return;
+        }
+        // move the last active node into the freed slot
+        node_t pos = position_[node];
+        node_t last = nodes_.back();
+        nodes_[pos] = last;
+        position_[last] = pos;
+        nodes_.pop_back();
+        position_[node] = npos;
+        passive_[node] = true;
+        if (activity_) {
+            activity_->deactivated(node);
+        }
+    }
+
+    // Reports the following activations and deactivations to activity (null to stop).
+    void track(node_activity_t* activity)
+    {
+        activity_ = activity;
+    }
+
+    std::size_t size() const
+    {
+        return nodes_.size();
+    }
+
+    bool empty() const
+    {
+        return nodes_.empty();
+    }
+
+    std::size_t node_count() const
+    {
+        return passive_.size();
+    }
+
+    // Number of distinct nodes that have been active at some point, including the initial ones.
+    std::size_t ever_active_count() const
+    {
+        return ever_active_.count();
+    }
+
+    // Fraction of active nodes.
+    long double density() const
+    {
+        return nodes_.size() / static_cast<long double>(passive_.size());
+    }
+
+    // Uniformly chosen active node. The set must not be empty.
+    template <class engine_t>
+    node_t random(engine_t& gen) const
+    {
+        return nodes_[uniform_index(gen, nodes_.size())];
+    }
+
+    const std::vector<node_t>& nodes() const
+    {
+        return nodes_;
+    }
+
+    // The order of the active nodes is part of the state: random() depends on it.
+    void save(binary_writer_t& out) const
+    {
+        std::vector<boost::dynamic_bitset<>::block_type> blocks;
+        boost::to_block_range(ever_active_, std::back_inserter(blocks));
+        out.write(nodes_);
+        out.write(blocks);
+    }
+
+    void load(binary_reader_t& in)
+    {
+        std::vector<boost::dynamic_bitset<>::block_type> blocks;
+        in.read(nodes_);
+        in.read(blocks);
+        if (blocks.size() != ever_active_.num_blocks()) {
+            throw std::runtime_error("Invalid checkpoint data.");
+        }
+        boost::from_block_range(blocks.begin(), blocks.end(), ever_active_);
+        passive_.set();
+        std::fill(position_.begin(), position_.end(), npos);
+        for (std::size_t k = 0; k < nodes_.size(); ++k) {
+            if (nodes_[k] >= passive_.size() || !passive_[nodes_[k]]) {
+                throw std::runtime_error("Invalid checkpoint data.");
+            }
+            passive_[nodes_[k]] = false;
+            position_[nodes_[k]] = static_cast<node_t>(k);
+        }
+    }
+
+    const boost::dynamic_bitset<>& states() const
+    {
+        return passive_;
+    }
+
+private:
+    boost::dynamic_bitset<> passive_;
+    boost::dynamic_bitset<> ever_active_;
+    std::vector<node_t> nodes_;
+    std::vector<node_t> position_;
+    node_activity_t* activity_;
+};
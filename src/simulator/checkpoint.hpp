@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "async_writer.hpp"
+#include "binary_io.hpp"
+#include "statistics.hpp"
+
+// Checkpoint of a simulator run.
+//
+// The file holds the run settings, the seed and one record per worker thread.
+// A record holds the statistics of the tasks ((lambda, repetition) pairs) the
+// thread has completed, their ids and, if the thread was inside a task, the
+// full state of that task including its own partial statistics. Records of
+// different threads never share tasks or sums, so the latest records of all
+// threads are consistent whenever each of them was taken: every thread
+// refreshes its own record when the interval has elapsed, and the file is
+// rewritten from all records. Tasks found in no record run again on resume.
+struct checkpoint_record_t
+{
+    std::vector<std::uint64_t> completed;
+    std::vector<char> statistics; // lambda_statistics_t::save() of every lambda, or empty
+    bool running = false;
+    std::uint64_t task = 0;
+    std::vector<char> task_state;
+
+    void save(binary_writer_t& out) const
+    {
+        out.write(completed);
+        out.write(statistics);
+        out.write(static_cast<std::uint8_t>(running));
+        out.write(task);
+        out.write(task_state);
+    }
+
+    void load(binary_reader_t& in)
+    {
+        std::uint8_t flag = 0;
+        in.read(completed);
+        in.read(statistics);
+        in.read(flag);
+        in.read(task);
+        in.read(task_state);
+        running = 0 != flag;
+    }
+};
+
+struct checkpoint_t
+{
+    enum : std::uint32_t
+    {
+        version = 3
+    };
+
+    static const char* magic()
+    {
+        return "HMNCKP\0\0";
+    }
+
+    std::string settings; // must match the resumed run
+    std::uint64_t seed = 0;
+    std::vector<checkpoint_record_t> records;
+
+    static checkpoint_t load(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) {
+            throw std::runtime_error("Cannot open checkpoint file.");
+        }
+        std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        binary_reader_t reader(data.data(), data.data() + data.size());
+        char file_magic[8];
+        std::uint32_t file_version = 0;
+        std::uint64_t record_count = 0;
+        reader.read(file_magic);
+        reader.read(file_version);
+        if (0 != std::memcmp(file_magic, magic(), sizeof(file_magic)) || version != file_version) {
+            throw std::runtime_error("Not a checkpoint file of this simulator version.");
+        }
+        checkpoint_t checkpoint;
+        reader.read(checkpoint.settings);
+        reader.read(checkpoint.seed);
+        reader.read(record_count);
+        for (std::uint64_t k = 0; k < record_count; ++k) {
+            checkpoint.records.emplace_back();
+            checkpoint.records.back().load(reader);
+        }
+        return checkpoint;
+    }
+};
+
+// Collects the records of all threads and rewrites the checkpoint file through
+// the async writer at most once per interval. The new file is written under a
+// temporary name and renamed over the old one, so a crash never leaves a
+// partial checkpoint behind. After a resume, interrupted tasks are kept as
+// records of their own until a thread has recorded them as running or done.
+class checkpointer_t
+{
+public:
+    typedef std::chrono::steady_clock clock_t;
+
+    checkpointer_t(async_writer_t& writer, const std::string& path, const std::string& settings, std::uint64_t seed, double interval_seconds, std::size_t thread_count)
+        : writer_(writer)
+        , path_(path)
+        , settings_(settings)
+        , seed_(seed)
+        , interval_(std::chrono::duration_cast<clock_t::duration>(std::chrono::duration<double>(interval_seconds)))
+        , records_(thread_count)
+        , last_save_(thread_count, clock_t::now())
+        , last_write_(clock_t::now())
+        , write_count_(0)
+    {
+    }
+
+    // Interrupted task of a resumed run, written until a thread takes it over.
+    void inherit(const checkpoint_record_t& record)
+    {
+        checkpoint_record_t task;
+        task.running = true;
+        task.task = record.task;
+        task.task_state = record.task_state;
+        std::lock_guard<std::mutex> lock(mutex_);
+        inherited_.emplace_back(std::move(task));
+    }
+
+    // True if the record of the thread is older than the interval.
+    bool due(std::size_t thread) const
+    {
+        return clock_t::now() - last_save_[thread] >= interval_;
+    }
+
+    void save(std::size_t thread, const checkpoint_record_t& record)
+    {
+        std::vector<char> data;
+        binary_writer_t out(data);
+        record.save(out);
+        const clock_t::time_point now = clock_t::now();
+        last_save_[thread] = now;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        records_[thread].swap(data);
+        for (std::size_t k = 0; k < inherited_.size();) {
+            std::uint64_t task = inherited_[k].task;
+            if ((record.running && record.task == task) || record.completed.end() != std::find(record.completed.begin(), record.completed.end(), task)) {
+                inherited_.erase(inherited_.begin() + k);
+            } else {
+                ++k;
+            }
+        }
+        if (now - last_write_ < interval_) {
+            return;
+        }
+        last_write_ = now;
+        async_writer_t::buffer_t file_data;
+        binary_writer_t file_out(file_data);
+        std::uint64_t record_count = inherited_.size();
+        for (const std::vector<char>& r : records_) {
+            record_count += !r.empty();
+        }
+        file_data.insert(file_data.end(), checkpoint_t::magic(), checkpoint_t::magic() + 8);
+        file_out.write(static_cast<std::uint32_t>(checkpoint_t::version));
+        file_out.write(settings_);
+        file_out.write(seed_);
+        file_out.write(record_count);
+        for (const std::vector<char>& r : records_) {
+            file_data.insert(file_data.end(), r.begin(), r.end());
+        }
+        for (const checkpoint_record_t& r : inherited_) {
+            r.save(file_out);
+        }
+        // a fresh temporary name per write, in case the previous one is still queued
+        const std::string temporary_path = path_ + "." + std::to_string(write_count_++) + ".tmp";
+        async_writer_t::file_t file = std::make_shared<std::ofstream>(temporary_path, std::ios::binary);
+        writer_.write(file, std::move(file_data));
+        writer_.commit(file, temporary_path, path_);
+    }
+
+    const std::string& path() const
+    {
+        return path_;
+    }
+
+private:
+    async_writer_t& writer_;
+    const std::string path_;
+    const std::string settings_;
+    const std::uint64_t seed_;
+    const clock_t::duration interval_;
+    std::vector<std::vector<char> > records_; // serialized, one per thread
+    std::vector<checkpoint_record_t> inherited_;
+    std::vector<clock_t::time_point> last_save_; // each entry only touched by its thread
+    clock_t::time_point last_write_;
+    std::size_t write_count_;
+    std::mutex mutex_;
+};
+
+// The record of one worker thread. Without a checkpointer it is never due and
+// saving does nothing, so the simulation loops need no separate code path.
+class thread_checkpoint_t
+{
+public:
+    thread_checkpoint_t(checkpointer_t* checkpointer, std::size_t thread, const std::vector<lambda_statistics_t>& statistics)
+        : checkpointer_(checkpointer)
+        , thread_(thread)
+        , statistics_(statistics)
+    {
+    }
+
+    bool due() const
+    {
+        return checkpointer_ && checkpointer_->due(thread_);
+    }
+
+    // Takes over the completed tasks of a record loaded on resume; their
+    // statistics are loaded into the thread's statistics by the caller.
+    void restore(const checkpoint_record_t& record)
+    {
+        record_.completed.insert(record_.completed.end(), record.completed.begin(), record.completed.end());
+    }
+
+    void complete(std::uint64_t task)
+    {
+        record_.completed.push_back(task);
+    }
+
+    // Saves the record while the task is running; save_state(binary_writer_t&)
+    // writes the state of its repetition.
+    template <class save_state_t>
+    void save(std::uint64_t task, save_state_t&& save_state)
+    {
+        if (!checkpointer_) {
+            return;
+        }
+        record_.running = true;
+        record_.task = task;
+        record_.task_state.clear();
+        binary_writer_t out(record_.task_state);
+        save_state(out);
+        write();
+    }
+
+    // Saves the record between tasks.
+    void save()
+    {
+        if (!checkpointer_) {
+            return;
+        }
+        record_.running = false;
+        record_.task_state.clear();
+        write();
+    }
+
+private:
+    void write()
+    {
+        record_.statistics.clear();
+        binary_writer_t out(record_.statistics);
+        for (const lambda_statistics_t& s : statistics_) {
+            s.save(out);
+        }
+        checkpointer_->save(thread_, record_);
+    }
+
+    checkpointer_t* checkpointer_;
+    std::size_t thread_;
+    const std::vector<lambda_statistics_t>& statistics_;
+    checkpoint_record_t record_;
+};
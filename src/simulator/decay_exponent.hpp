@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "trajectory_accumulator.hpp"
+
+// Decay exponent delta of the averaged density, rho(t) ~ t^-delta, fitted by
+// least squares of log rho against log t over a time window, each bin weighted
+// by the span of log t it covers. Repetitions come in batches; the error is
+// the 95% jackknife interval over the batches, which, unlike the fit residuals,
+// accounts for the correlation between the bins of one repetition.
+class decay_exponent_t
+{
+public:
+    // The jackknife interval is not trusted with fewer batches.
+    static constexpr std::size_t min_batch_count = 4;
+
+    // bin_times[i] is the time of bin i; bins with times in [min_time, max_time] are fitted.
+    decay_exponent_t(const std::vector<double>& bin_times, double min_time, double max_time)
+        : total_repetitions_(0)
+    {
+        for (std::size_t i = 0; i < bin_times.size(); ++i) {
+            const double t = bin_times[i];
+            if (t <= 0. || t < min_time || t > max_time) {
+                continue;
+            }
+            const double next = i + 1 < bin_times.size() ? bin_times[i + 1] : 2. * t - (i > 0 ? bin_times[i - 1] : 0.);
+            bins_.emplace_back(i);
+            log_times_.emplace_back(std::log(t));
+            weights_.emplace_back((next - t) / t);
+        }
+        total_sums_.assign(bins_.size(), 0.);
+    }
+
+    // Adds the density sums of a batch of repetitions.
+    void add_batch(const trajectory_accumulator_t& density, const time_binning_t& binning, std::size_t repetition_count)
+    {
+        std::vector<double> sums(bins_.size(), 0.);
+        for (std::size_t k = 0; k < bins_.size(); ++k) {
+            if (bins_[k] < density.size()) {
+                sums[k] = density.sum(bins_[k]) / binning.width(bins_[k]);
+                total_sums_[k] += sums[k];
+            }
+        }
+        batch_sums_.emplace_back(sums);
+        batch_repetitions_.emplace_back(repetition_count);
+        total_repetitions_ += repetition_count;
+    }
+
+    std::size_t batch_count() const
+    {
+        return batch_sums_.size();
+    }
+
+    // Fit over all batches; NaN if fewer than two bins of the window have a positive density.
+    double exponent() const
+    {
+        return fit(batch_count());
+    }
+
+    // Half width of the 95% confidence interval; infinite below min_batch_count batches.
+    double error() const
+    {
+        const std::size_t m = batch_count();
+        if (m < min_batch_count) {
+            return std::numeric_limits<double>::infinity();
+        }
+        std::vector<double> partial(m);
+        double mean = 0.;
+        for (std::size_t j = 0; j < m; ++j) {
+            partial[j] = fit(j);
+            if (std::isnan(partial[j])) {
+                return std::numeric_limits<double>::infinity();
+            }
+            mean += partial[j] / m;
+        }
+        double variance = 0.;
+        for (double delta : partial) {
+            variance += (delta - mean) * (delta - mean);
+        }
+        variance *= (m - 1.) / m;
+        return 1.96 * std::sqrt(variance);
+    }
+
+private:
+    // Fit without batch 'excluded'; excluded == batch_count() uses all of them.
+    double fit(std::size_t excluded) const
+    {
+        std::size_t repetitions = total_repetitions_;
+        if (excluded < batch_count()) {
+            repetitions -= batch_repetitions_[excluded];
+        }
+        if (0 == repetitions) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        double w_sum = 0.;
+        double x_sum = 0.;
+        double y_sum = 0.;
+        std::vector<double> ys(bins_.size(), 0.);
+        std::vector<char> used(bins_.size(), 0);
+        for (std::size_t k = 0; k < bins_.size(); ++k) {
+            double sum = total_sums_[k] - (excluded < batch_count() ? batch_sums_[excluded][k] : 0.);
+            if (sum <= 0.) {
+                continue;
+            }
+            used[k] = 1;
+            ys[k] = std::log(sum / repetitions);
+            w_sum += weights_[k];
+            x_sum += weights_[k] * log_times_[k];
+            y_sum += weights_[k] * ys[k];
+        }
+        if (w_sum <= 0.) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        const double x_mean = x_sum / w_sum;
+        const double y_mean = y_sum / w_sum;
+        double sxy = 0.;
+        double sxx = 0.;
+        std::size_t point_count = 0;
+        for (std::size_t k = 0; k < bins_.size(); ++k) {
+            if (used[k]) {
+                sxy += weights_[k] * (log_times_[k] - x_mean) * (ys[k] - y_mean);
+                sxx += weights_[k] * (log_times_[k] - x_mean) * (log_times_[k] - x_mean);
+                ++point_count;
+            }
+        }
+        if (point_count < 2 || sxx <= 0.) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        return -sxy / sxx;
+    }
+
+    std::vector<std::size_t> bins_; // bins of the fit window
+    std::vector<double> log_times_;
+    std::vector<double> weights_;
+    std::vector<std::vector<double> > batch_sums_; // per batch: sum over repetitions of the bin means
+    std::vector<std::size_t> batch_repetitions_;
+    std::vector<double> total_sums_;
+    std::size_t total_repetitions_;
+};
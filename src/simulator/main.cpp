@@ -6,6 +6,7 @@
 #include <iostream>
 #include <list>
 #include <map>
+#include <memory>
 #include <random>
 #include <set>
 #include <sstream>
@@ -15,6 +16,22 @@
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
 
+#include <omp.h>
+
+#include "checkpoint.hpp"
+#include "decay_exponent.hpp"
+#include "model.hpp"
+#include "model_simulator.hpp"
+#include "node_activity.hpp"
+#include "statistics.hpp"
+#include "telemetry.hpp"
+#include "trajectory_accumulator.hpp"
+#include "column_reader.hpp"
+#include "csr_graph.hpp"
+#include "hmn.hpp"
+#include "node_ordering.hpp"
+#include "random.hpp"
+
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 
@@ -27,97 +44,301 @@ std::string output_folder;
 
 bool keep_intermediate_output = false;
 
-struct model_parameters_t
-{
-    double mu_;
-    double lambda_;
-    double alpha_;
-    std::size_t step_count_;
-};
-
-class model_t
-{
-    model_parameters_t parameters_;
-};
-
-class model_a_t : public model_t
+// Random engine of the simulation core. Build with -DSIMULATOR_MT19937 to use std::mt19937_64 instead.
+#ifdef SIMULATOR_MT19937
+typedef std::mt19937_64 base_random_engine_t;
+const char* const random_engine_name = "mt19937_64";
+#else
+typedef xoshiro256pp_t base_random_engine_t;
+const char* const random_engine_name = "xoshiro256++";
+#endif
+
+#ifdef SIMULATOR_TELEMETRY
+typedef counting_engine_t<base_random_engine_t> random_engine_t;
+#else
+typedef base_random_engine_t random_engine_t;
+#endif
+
+// Log-spaced sampling times in [min_time, max_time].
+std::vector<double> make_log_time_grid(double min_time, double max_time, std::size_t points_per_decade)
 {
-};
+    std::vector<double> grid;
+    for (std::size_t k = 0;; ++k) {
+        double t = min_time * std::pow(10.0, k / static_cast<double>(points_per_decade));
+        if (t > max_time) {
+            break;
+        }
+        grid.emplace_back(t);
+    }
+    return grid;
+}
 
-class model_b_t : public model_t
+// One network of the run: the loaded network, or one generated realization of
+// the ensemble, with its initial states, random seed and internal node numbering.
+struct realization_t
 {
+    csr_graph_t graph;
+    boost::dynamic_bitset<> initial_states;
+    simulation_settings_t settings;
+    node_permutation_t permutation;
 };
 
-class model_simulator_t
+// Simulates repetitions first_repetition..first_repetition+repetition_count-1 of every
+// (realization, lambda) pair with the model policy model_type and adds the results to
+// statistics[lambda index], so that they are averaged over the realizations and the
+// repetitions alike. With a nonzero activity_node_count, the statistics also track
+// the activity of every node. Progress is saved through
+// checkpointer, if given; a run resumed from checkpoint only simulates what it does not
+// hold. The worker threads report to telemetry, if given.
+template <class model_type>
+void simulate_all(const model_parameters_t& model_parameters, const std::vector<double>& lambdas, std::size_t first_repetition, std::size_t repetition_count, const std::vector<realization_t>& realizations, const time_binning_t& binning, const observer_settings_t& observer_settings, std::size_t activity_node_count,
+    std::vector<lambda_statistics_t>& statistics, checkpointer_t* checkpointer, const checkpoint_t* checkpoint, telemetry_reporter_t* telemetry)
 {
-public:
-    model_simulator_t();
-    void simulate(std::shared_ptr<model_t> model);
-
-private:
-    model_parameters_t parameters_;
-};
+    // models[k * lambdas.size() + l]; the copies for the other lambdas share whatever
+    // the model precomputed from the graph of realization k
+    std::vector<model_type> models;
+    models.reserve(realizations.size() * lambdas.size());
+    for (const realization_t& realization : realizations) {
+        const model_type prototype(model_parameters, realization.graph);
+        for (double lambda : lambdas) {
+            models.push_back(prototype);
+            models.back().set_lambda(lambda);
+        }
+    }
 
-void perform_propagation_model_a(const std::mt19937& gen, const std::vector<std::size_t>& inactive_neighbours, boost::dynamic_bitset<>& states)
-{
-    std::vector<std::size_t> inactive_neighbours;
-    for (std::size_t i : adj[node]) {
-        if (states[i]) {
-            inactive_neighbours.emplace_back(i);
+    // All (realization, lambda, repetition) triples form one pool of tasks, so threads
+    // that finish short (absorbed) repetitions keep picking up work from any lambda and
+    // any realization. The multispin engine runs blocks of 64 repetitions per task.
+    const bool multispin = realizations.front().settings.engine == "multispin";
+    const std::size_t block_count = multispin ? (repetition_count + replica_states_t::width - 1) / replica_states_t::width : repetition_count;
+    const std::size_t sweep_size = realizations.size() * lambdas.size();
+    const std::size_t task_count = sweep_size * block_count;
+
+    // tasks completed or interrupted in the resumed run, and the statistics of the completed ones
+    std::vector<char> completed(task_count, 0);
+    std::map<std::uint64_t, const std::vector<char>*> interrupted;
+    std::vector<const checkpoint_record_t*> restored_records;
+    std::vector<std::vector<lambda_statistics_t> > restored_statistics;
+    if (checkpoint) {
+        for (const checkpoint_record_t& record : checkpoint->records) {
+            for (std::uint64_t task : record.completed) {
+                if (task >= task_count || completed[task]) {
+                    throw std::runtime_error("Invalid checkpoint data.");
+                }
+                completed[task] = 1;
+            }
+            if (record.running) {
+                if (record.task >= task_count || !interrupted.emplace(record.task, &record.task_state).second) {
+                    throw std::runtime_error("Invalid checkpoint data.");
+                }
+                if (checkpointer) {
+                    checkpointer->inherit(record);
+                }
+            }
+            if (!record.statistics.empty()) {
+                binary_reader_t in(record.statistics.data(), record.statistics.data() + record.statistics.size());
+                restored_statistics.emplace_back(lambdas.size(), lambda_statistics_t(binning, observer_settings, activity_node_count));
+                for (lambda_statistics_t& s : restored_statistics.back()) {
+                    s.load(in);
+                }
+                if (!in.at_end()) {
+                    throw std::runtime_error("Invalid checkpoint data.");
+                }
+                restored_records.emplace_back(&record);
+            }
+        }
+        for (const auto& task : interrupted) {
+            if (completed[task.first]) {
+                throw std::runtime_error("Invalid checkpoint data.");
+            }
         }
     }
-    if (!inactive_neighbours.empty()) {
-        std::uniform_int_distribution<std::size_t> uid{ 0, inactive_neighbours.size() - 1 };
-        std::size_t node_2 = inactive_neighbours[uid(gen)];
-        states[node_2] = false;
+    // interrupted tasks go first, so that threads soon take over their saved state
+    std::vector<std::uint64_t> pending;
+    for (const auto& task : interrupted) {
+        pending.emplace_back(task.first);
     }
-}
-void perform_propagation_model_b(const std::mt19937& gen, const std::vector<std::size_t>& inactive_neighbours, boost::dynamic_bitset<>& states)
-{
-    std::vector<std::size_t> inactive_neighbours;
-    for (std::size_t i : adj[node]) {
-        if (states[i]) {
-            inactive_neighbours.emplace_back(i);
+    for (std::uint64_t task = 0; task < task_count; ++task) {
+        if (!completed[task] && !interrupted.count(task)) {
+            pending.emplace_back(task);
         }
     }
-    if (!inactive_neighbours.empty()) {
-        for (std::size_t y = 0; y < inactive_neighbours.size(); ++y)
+
+#pragma omp parallel
+    {
+        // per-thread partial sums, merged once after all tasks of the thread are done
+        const lambda_statistics_t empty_statistics(binning, observer_settings, activity_node_count);
+        std::vector<lambda_statistics_t> local_statistics(lambdas.size(), empty_statistics);
+        lambda_statistics_t task_statistics(empty_statistics);
+        const std::size_t thread = omp_get_thread_num();
+        thread_checkpoint_t thread_checkpoint(checkpointer, thread, local_statistics);
+        if (telemetry) {
+            telemetry->attach(thread);
+        }
+
+        // the restored records are dealt out to the threads; loading rather than merging
+        // the first one keeps a resumed single thread run bit-exact
+        bool restored = false;
+        for (std::size_t j = thread; j < restored_records.size(); j += omp_get_num_threads()) {
+            if (!restored) {
+                local_statistics = restored_statistics[j];
+            } else {
+                for (std::size_t l = 0; l < lambdas.size(); ++l) {
+                    local_statistics[l].merge(restored_statistics[j][l]);
+                }
+            }
+            thread_checkpoint.restore(*restored_records[j]);
+            restored = true;
+        }
+        if (restored) {
+            thread_checkpoint.save();
+        }
+
+#pragma omp for schedule(dynamic)
+        for (std::size_t j = 0; j < pending.size(); ++j) {
+            const std::uint64_t task = pending[j];
+            std::size_t l = task % lambdas.size();
+            std::size_t k = task / lambdas.size() % realizations.size();
+            std::size_t r = task / sweep_size;
+            const realization_t& realization = realizations[k];
+            auto saved = interrupted.find(task);
+            const std::vector<char>* saved_state = saved == interrupted.end() ? nullptr : saved->second;
+            // the task keeps its statistics apart until it is done, so a checkpoint holds
+            // them either with the state of the task or with the completed tasks; the copy
+            // clears them but keeps the storage of the previous task
+            task_statistics = empty_statistics;
+            model_simulator_t<model_type, random_engine_t> simulator(models[k * lambdas.size() + l], realization.settings, realization.graph, realization.initial_states);
+            if (multispin) {
+                std::size_t first = r * replica_states_t::width;
+                simulator.simulate_replicas(first_repetition + first, std::min(replica_states_t::width, repetition_count - first), task_statistics, thread_checkpoint, task, saved_state);
+            } else {
+                simulator.simulate(first_repetition + r, task_statistics, thread_checkpoint, task, saved_state);
+            }
+            local_statistics[l].merge(task_statistics);
+            thread_checkpoint.complete(task);
+        }
+        thread_checkpoint.save();
+
+#pragma omp critical
         {
-            if (1 == bernoulli_propagation(gen))
-            {
-                states[inactive_neighbours[y]] = false;
+            for (std::size_t l = 0; l < lambdas.size(); ++l) {
+                statistics[l].merge(local_statistics[l]);
             }
         }
     }
-    states[active_nodes[rand_index]] = true;
 }
 
+// Parses either 'start:stop:step' or a comma separated list of values.
+bool parse_lambdas(const std::string& input, std::vector<double>& lambdas)
+{
+    try {
+        if (std::string::npos != input.find(':')) {
+            std::size_t first = input.find(':');
+            std::size_t second = input.find(':', first + 1);
+            if (std::string::npos == second) {
+                return false;
+            }
+            double start = std::stod(input.substr(0, first));
+            double stop = std::stod(input.substr(first + 1, second - first - 1));
+            double step = std::stod(input.substr(second + 1));
+            if (step <= 0. || stop < start) {
+                return false;
+            }
+            // tolerate rounding of the last point
+            std::size_t count = static_cast<std::size_t>(std::floor((stop - start) / step + 1e-9)) + 1;
+            for (std::size_t i = 0; i < count; ++i) {
+                lambdas.emplace_back(start + i * step);
+            }
+        } else {
+            std::stringstream ss(input);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                lambdas.emplace_back(std::stod(item));
+            }
+        }
+    } catch (std::exception&) {
+        return false;
+    }
+    return !lambdas.empty();
+}
 
 int main(int argc, char* argv[])
 {
     double mu = 0.;
     double lambda = 0.;
+    std::string lambda_range;
     std::string activation_mode;
     std::string network_path;
     std::string active_nodes_path;
     double alpha = 0.;
     std::size_t step_count = 0;
+    std::string engine;
+    double min_time = 0.;
+    double max_time = 0.;
+    std::size_t points_per_decade = 0;
+    std::size_t bins_per_decade = 0;
+    double exponent_tolerance = 0.;
+    std::string exponent_window;
+    std::size_t repetition_batch = 0;
+    std::size_t qs_history = 0;
+    double qs_snapshot_interval = 0.;
+    double qs_relaxation = 0.;
     std::string model;
     std::string output_folder;
     std::size_t repetition_count = 1;
+    std::uint64_t seed = 0;
+    double checkpoint_interval = 0.;
+    bool resume = false;
+    double telemetry_interval = 0.;
+    std::string telemetry_path;
+    std::string node_order;
+    bool node_activity = false;
+    std::size_t realization_count = 0;
+    hmn_parameters_t hmn_parameters{ 0, 0, 0, 0., 0. };
     bool keep_intermediate_output = false;
+    observer_settings_t observer_settings;
     po::options_description desc("Program options");
     desc.add_options()("help", "Produce help message")(
-        "network", po::value<std::string>(&network_path)->required(), "Network path")(
+        "network", po::value<std::string>(&network_path), "Network path")(
+        "realizations", po::value<std::size_t>(&realization_count), "Ensemble mode: instead of reading --network, generate this many HMN realizations in memory from the --hmn_* parameters and average over them and over the repetitions on each of them. Trajectories of repetitions are kept in <output>/realization_<k>.")(
+        "hmn_S", po::value<std::size_t>(&hmn_parameters.S), "Level count of the generated networks (ensemble mode)")(
+        "hmn_b", po::value<std::size_t>(&hmn_parameters.b), "Block size of the generated networks (ensemble mode), and of the node activity blocks")(
+        "hmn_M_0", po::value<std::size_t>(&hmn_parameters.M0), "Module size of the generated networks (ensemble mode), and of the node activity modules")(
+        "hmn_p", po::value<double>(&hmn_parameters.p)->default_value(0.25), "Probability of the generated networks (ensemble mode)")(
+        "hmn_alpha", po::value<double>(&hmn_parameters.alpha)->default_value(1.0), "Alpha of the generated networks (ensemble mode)")(
         "activation_mode", po::value<std::string>(&activation_mode)->default_value("all"), "Activation mode: 'all' - activate all nodes, 'file' - read nodes from file, provided by --active-nodes option.")(
         "active_nodes", po::value<std::string>(&active_nodes_path), "Active nodes path")(
-        "model", po::value<std::string>(&model)->default_value("A"), "Activity propagation model")(
+        "node_order", po::value<std::string>(&node_order)->default_value("none"), "Internal node numbering: 'none' - as in the network file, 'rcm' - reverse Cuthill-McKee, which puts neighbours close in memory and speeds up networks without a local numbering. Node ids of input and output files are not affected; runs with a fixed seed differ between orderings.")(
+        "model", po::value<std::string>(&model)->default_value("A"), "Activity propagation model: 'A' - activate one random inactive neighbour, 'B' - activate each inactive neighbour with probability lambda / (lambda + mu) and deactivate, 'CP' - contact process, activate a neighbour chosen with probability proportional to its degree to the power alpha.")(
+        "alpha", po::value<double>(&alpha)->default_value(0.), "Degree weighting exponent of the CP model.")(
         "mu", po::value<double>(&mu)->default_value(1.0), "Deactivation rate")(
-        "lambda", po::value<double>(&lambda)->required(), "Activity propagation rate")(
-        "step_count", po::value<std::size_t>(&step_count)->default_value(10 * 1000 * 1000), "Step count")(
+        "lambda", po::value<double>(&lambda), "Activity propagation rate")(
+        "lambda_range", po::value<std::string>(&lambda_range), "Activity propagation rates to sweep in one run: 'start:stop:step' or a comma separated list. Replaces --lambda.")(
+        "engine", po::value<std::string>(&engine)->default_value("discrete"), "Simulation engine: 'discrete' - one reaction per time step, 'gillespie' - continuous time with exponential waiting times, 'multispin' - gillespie dynamics of 64 repetitions at once, one bit per repetition (repetitions of a block are correlated; the standard errors of the averaged density are taken over blocks).")(
+        "step_count", po::value<std::size_t>(&step_count)->default_value(10 * 1000 * 1000), "Step count (discrete engine)")(
+        "min_time", po::value<double>(&min_time)->default_value(0.1), "First sampling time (gillespie engine)")(
+        "max_time", po::value<double>(&max_time)->default_value(10000.0), "Simulated physical time (gillespie engine)")(
+        "points_per_decade", po::value<std::size_t>(&points_per_decade)->default_value(20), "Sampling points per time decade (gillespie engine)")(
+        "bins_per_decade", po::value<std::size_t>(&bins_per_decade)->default_value(20), "Average the trajectory over log-spaced step bins, this many per decade (discrete engine). 0 keeps every step.")(
         "output", po::value<std::string>(&output_folder)->default_value("."), "Output folder")(
-        "keep_intermediate_output", po::value<bool>(&keep_intermediate_output)->default_value(false), "Keep output for all repetitions. If false, only averaged trajectory will be saved.")(
-        "repetitions", po::value<std::size_t>(&repetition_count)->default_value(1), "Repetition count");
+        "keep_intermediate_output", po::value<bool>(&keep_intermediate_output)->default_value(false), "Keep output for all repetitions as binary result_<lambda>_<r>.trj files (see trajectory_converter). If false, only averaged trajectory will be saved.")(
+        "repetitions", po::value<std::size_t>(&repetition_count)->default_value(1), "Repetition count; the maximum when --exponent_tolerance is set.")(
+        "exponent_tolerance", po::value<double>(&exponent_tolerance)->default_value(0.), "Run the repetitions in batches and stop for a lambda once the 95% confidence interval of the decay exponent of its density, rho(t) ~ t^-delta, is within +- this value. 0 runs all repetitions.")(
+        "exponent_window", po::value<std::string>(&exponent_window), "Time window 'min:max' of the decay exponent fit. The last two decades of the simulated time if not set.")(
+        "repetition_batch", po::value<std::size_t>(&repetition_batch)->default_value(16), "Repetitions per batch with --exponent_tolerance (a multiple of 64 for the multispin engine).")(
+        "qs_history", po::value<std::size_t>(&qs_history)->default_value(0), "Quasi-stationary method (discrete and gillespie engines): keep this many recent configurations of every repetition and continue an absorbed repetition from a random one of them. The QS density and lifetime per lambda are written to result_quasi_stationary.txt. 0 ends repetitions on absorption.")(
+        "qs_snapshot_interval", po::value<double>(&qs_snapshot_interval)->default_value(100.), "Time between configurations stored for the quasi-stationary method: steps (discrete engine) or physical time (gillespie engine).")(
+        "qs_relaxation", po::value<double>(&qs_relaxation)->default_value(0.5), "Fraction of the simulated time discarded before the quasi-stationary averages.")(
+        "start_step", po::value<std::size_t>(&observer_settings.start_step)->default_value(0), "First step seen by the online observers (discrete engine).")(
+        "histogram_bin", po::value<double>(&observer_settings.histogram_bin)->default_value(0.), "Bin width of the online density histogram written to result_<lambda>_histogram.txt. 0 disables it.")(
+        "correlator_points", po::value<std::size_t>(&observer_settings.correlator_points)->default_value(0), "Lags per level of the online multi-tau density autocorrelation written to result_<lambda>_autocorrelation.txt. 0 disables it.")(
+        "moments", po::value<bool>(&observer_settings.moments)->default_value(false), "Write the running density mean and variance to result_<lambda>_moments.txt.")(
+        "node_activity", po::value<bool>(&node_activity)->default_value(false), "Track the activity of every node (discrete and gillespie engines) and write result_<lambda>_activity.bin: per node, the fraction of the simulated time it was active and its activations per repetition, plus the means over the modules (--hmn_M_0) and the blocks of --hmn_b^l nodes of the hierarchy, for locating rare active regions.")(
+        "seed", po::value<std::uint64_t>(&seed), "Random seed. Every (lambda, repetition) pair gets its own deterministic stream; in ensemble mode every realization also gets its own network. Drawn from std::random_device if not set.")(
+        "checkpoint_interval", po::value<double>(&checkpoint_interval)->default_value(0.), "Seconds between checkpoints of the run written to <output>/checkpoint.bin. 0 disables checkpoints.")(
+        "resume", po::value<bool>(&resume)->default_value(false), "Continue the run saved in <output>/checkpoint.bin. All other options must be the same as in the saved run.")(
+        "telemetry_interval", po::value<double>(&telemetry_interval)->default_value(0.), "Seconds between telemetry reports (step rates, time shares of the step, active set size, random draws per step). 0 disables them. Needs a build with -DSIMULATOR_TELEMETRY.")(
+        "telemetry_output", po::value<std::string>(&telemetry_path), "JSON lines file for the telemetry reports. They are written to stderr if not set.");
 
     po::variables_map vm;
     try {
@@ -135,184 +356,502 @@ int main(int argc, char* argv[])
         return 0;
     }
 
-    if (!fs::exists(network_path)) {
-        std::cerr << "Invalid network file path." << std::endl;
+    std::vector<double> lambdas;
+    if (vm.count("lambda_range")) {
+        if (vm.count("lambda") || !parse_lambdas(lambda_range, lambdas)) {
+            std::cerr << "Invalid lambda range." << std::endl;
+            return -1;
+        }
+    } else if (vm.count("lambda")) {
+        lambdas.emplace_back(lambda);
+    } else {
+        std::cerr << "Either --lambda or --lambda_range is required." << std::endl;
         return -1;
     }
 
-    if (!fs::exists(output_folder)) {
-        fs::create_directory(output_folder);
+    if (node_order != "none" && node_order != "rcm") {
+        std::cerr << "Invalid node order." << std::endl;
+        return -1;
+    }
+
+    if (model != "A" && model != "B" && model != "CP") {
+        std::cerr << "Invalid model." << std::endl;
+        return -1;
+    }
+
+    if (engine != "discrete" && engine != "gillespie" && engine != "multispin") {
+        std::cerr << "Invalid engine." << std::endl;
+        return -1;
+    }
+
+    if (engine == "multispin" && keep_intermediate_output) {
+        std::cerr << "The multispin engine does not write per-repetition trajectories." << std::endl;
+        return -1;
+    }
+
+    if (checkpoint_interval < 0.) {
+        std::cerr << "Invalid checkpoint interval." << std::endl;
+        return -1;
+    }
+
+    if (telemetry_interval < 0. || (telemetry_interval > 0. && !telemetry_compiled)) {
+        std::cerr << "Invalid telemetry interval; telemetry needs a build with -DSIMULATOR_TELEMETRY." << std::endl;
+        return -1;
+    }
+
+    if (exponent_tolerance < 0. || (exponent_tolerance > 0. && (0 == repetition_batch || (engine == "multispin" && 0 != repetition_batch % replica_states_t::width)))) {
+        std::cerr << "Invalid exponent tolerance or repetition batch." << std::endl;
+        return -1;
+    }
+
+    if (qs_history > 0 && (engine == "multispin" || qs_snapshot_interval <= 0. || qs_relaxation < 0. || qs_relaxation >= 1.)) {
+        std::cerr << "Invalid quasi-stationary settings; the method needs the discrete or gillespie engine." << std::endl;
+        return -1;
+    }
+
+    if (node_activity && engine == "multispin") {
+        std::cerr << "Node activity needs the discrete or gillespie engine." << std::endl;
+        return -1;
+    }
+
+    if ((checkpoint_interval > 0. || resume) && exponent_tolerance > 0.) {
+        std::cerr << "Checkpoints do not cover runs with an exponent tolerance." << std::endl;
+        return -1;
+    }
+
+    if ((checkpoint_interval > 0. || resume) && keep_intermediate_output) {
+        std::cerr << "Checkpoints do not cover per-repetition trajectories." << std::endl;
+        return -1;
+    }
+
+    if (engine != "discrete" && (min_time <= 0. || max_time < min_time || 0 == points_per_decade)) {
+        std::cerr << "Invalid sampling time grid." << std::endl;
+        return -1;
+    }
+
+    if (observer_settings.enabled() && engine != "discrete") {
+        std::cerr << "Online observers need the discrete engine." << std::endl;
+        return -1;
     }
 
-    std::vector<std::set<std::size_t> > adj;
+    if (observer_settings.histogram_bin < 0. || 1 == observer_settings.correlator_points || 0 != observer_settings.correlator_points % 2) {
+        std::cerr << "Invalid observer settings." << std::endl;
+        return -1;
+    }
 
-    std::size_t N = 0;
-    std::ifstream network_file(network_path);
-    if (network_file.is_open()) {
-        network_file >> N;
-        adj.resize(N);
-        std::size_t v1, v2;
-        while (network_file >> v1 >> v2) {
-            adj[v1].insert(v2);
-            adj[v2].insert(v1);
+    const bool ensemble = vm.count("realizations") > 0;
+    if (ensemble) {
+        if (vm.count("network") || 0 == realization_count || !vm.count("hmn_S") || !vm.count("hmn_b") || !vm.count("hmn_M_0")) {
+            std::cerr << "Ensemble mode needs --realizations, --hmn_S, --hmn_b and --hmn_M_0 instead of --network." << std::endl;
+            return -1;
         }
+    } else if (!vm.count("network") || !fs::exists(network_path)) {
+        std::cerr << "Invalid network file path." << std::endl;
+        return -1;
     }
 
-    boost::dynamic_bitset<> initial_states(N, activation_mode == "file" ? std::numeric_limits<unsigned long>::max() : 0);
-    // State array of the nodes. if states[i]==true then node i is inactive else node i is active.
+    if (!fs::exists(output_folder)) {
+        fs::create_directory(output_folder);
+    }
 
+    std::vector<std::uint64_t> active_nodes;
     if (activation_mode == "file") {
         if (!fs::exists(active_nodes_path)) {
             std::cerr << "Invalid active nodes file path." << std::endl;
             return -1;
         }
-        std::ifstream active_nodes_file(active_nodes_path);
-        if (active_nodes_file.is_open()) {
-            std::size_t v;
-            while (network_file >> v) {
-                if (v < N) {
-                    initial_states[v] = false;
-                } else {
-                    std::cerr << "Invalid vertex index." << std::endl;
-                    return -1;
-                }
-            }
+        try {
+            column_reader_t reader(active_nodes_path);
+            active_nodes = reader.read_integers();
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
         }
     }
 
-    double propagation_p = lambda / (lambda + mu); // the probability of activity propagation reaction.
-    double deactication_p = mu / (lambda + mu); // the probability of the node deactivation reaction.
-
-    std::vector<std::string> output_file_names;
-
-    std::vector<long double> averaged_points(step_count, 0.0);
+    simulation_settings_t settings;
+    settings.engine = engine;
+    settings.model = model;
+    settings.keep_intermediate_output = keep_intermediate_output;
+    // bounded queue of trajectory chunks and checkpoints written by a background thread
+    std::unique_ptr<async_writer_t> writer;
+    if (keep_intermediate_output || checkpoint_interval > 0.) {
+        writer.reset(new async_writer_t(256 << 20));
+    }
+    settings.writer = writer.get();
+    settings.output_folder = output_folder;
 
-#pragma omp parallel for
-    for (std::size_t r = 0; r < repetition_count; ++r) {
+    // both continuous time engines sample the same log-spaced grid
+    const bool gillespie = engine != "discrete";
+    if (gillespie) {
+        settings.time_grid = make_log_time_grid(min_time, max_time, points_per_decade);
+    }
+    settings.qs_history = qs_history;
+    settings.qs_snapshot_interval = qs_snapshot_interval;
+    settings.qs_relaxation = qs_relaxation * (!gillespie ? static_cast<double>(step_count) : settings.time_grid.empty() ? 0. : settings.time_grid.back());
+
+    // the seed is needed before the networks of an ensemble can be generated
+    const std::string checkpoint_path = output_folder + "/checkpoint.bin";
+    checkpoint_t checkpoint;
+    if (resume) {
+        try {
+            checkpoint = checkpoint_t::load(checkpoint_path);
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+        if (vm.count("seed") && seed != checkpoint.seed) {
+            std::cerr << "The checkpoint was saved with seed " << checkpoint.seed << "." << std::endl;
+            return -1;
+        }
+        seed = checkpoint.seed;
+    } else if (!vm.count("seed")) {
         std::random_device rd;
-        std::mt19937 gen(rd());
-
-        std::bernoulli_distribution bernoulli_deactivation(deactication_p);
-        std::bernoulli_distribution bernoulli_propagation(propagation_p);
+        seed = (static_cast<std::uint64_t>(rd()) << 32) | rd();
+    }
+    std::cout << "seed = " << seed << std::endl;
+
+    // Realization k of an ensemble is generated from seed hash_combine(seed, 2k) and
+    // simulated with seed hash_combine(seed, 2k + 1); a single network uses the seed as is.
+    std::vector<realization_t> realizations(ensemble ? realization_count : 1);
+    for (std::size_t k = 0; k < realizations.size(); ++k) {
+        realization_t& realization = realizations[k];
+        csr_graph_t& graph = realization.graph;
+        realization.settings = settings;
+        // internal node ids; node ids in input and output files are those of the network file
+        node_permutation_t& permutation = realization.permutation;
+        try {
+            if (ensemble) {
+                graph = generate_hmn(hmn_parameters, hash_combine(seed, 2 * k));
+                realization.settings.seed = hash_combine(seed, 2 * k + 1);
+                realization.settings.output_folder = output_folder + "/realization_" + std::to_string(k);
+                if (keep_intermediate_output && !fs::exists(realization.settings.output_folder)) {
+                    fs::create_directory(realization.settings.output_folder);
+                }
+            } else {
+                graph = csr_graph_t::load(network_path);
+                realization.settings.seed = seed;
+            }
+            permutation = make_node_permutation(graph, node_order);
+            if (node_order != "none") {
+                graph = graph.permuted(permutation.new_index());
+                realization.settings.original_ids = realization.permutation.original_index().data();
+            }
+        } catch (std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return -1;
+        }
+        const std::size_t N = graph.node_count();
 
-        std::stringstream name;
-        std::ofstream fout;
-        if (keep_intermediate_output) {
-            name << output_folder << "/result_" << lambda << "_" << r << ".txt";
-            fout.open(name.str());
+        // State array of the nodes. if states[i]==true then node i is inactive else node i is active.
+        boost::dynamic_bitset<>& initial_states = realization.initial_states;
+        initial_states.resize(N);
+        if (activation_mode == "file") {
+            initial_states.set();
         }
-        /*if (!fout.is_open()) {
-            std::cerr << "Cannot create output file." << std::endl;
-            return -1;
-        }*/
-        if (keep_intermediate_output) {
-#pragma omp critical
-            {
-                output_file_names.emplace_back(name.str());
+        for (std::uint64_t v : active_nodes) {
+            if (v < N) {
+                initial_states[permutation.to_internal(static_cast<node_t>(v))] = false;
+            } else {
+                std::cerr << "Invalid vertex index." << std::endl;
+                return -1;
             }
         }
+    }
 
-        std::size_t time = 0;
-        std::size_t cache_size = 100000;
-        std::vector<long double> points(cache_size);
-        boost::dynamic_bitset<> states = initial_states;
+    // everything the results depend on except the seed, compared on resume
+    std::ostringstream fingerprint;
+    fingerprint.precision(17);
+    fingerprint << random_engine_name << " " << engine << " " << model << " " << mu << " " << alpha << " " << repetition_count << " " << step_count << " "
+                << min_time << " " << max_time << " " << points_per_decade << " " << bins_per_decade << " " << observer_settings.start_step << " "
+                << observer_settings.histogram_bin << " " << observer_settings.correlator_points << " " << observer_settings.moments << " "
+                << qs_history << " " << qs_snapshot_interval << " " << qs_relaxation << " " << node_activity << " lambdas";
+    for (double l : lambdas) {
+        fingerprint << " " << l;
+    }
+    for (const realization_t& realization : realizations) {
+        const csr_graph_t& graph = realization.graph;
+        const std::size_t N = graph.node_count();
+        std::uint64_t graph_hash = hash_combine(N, graph.entry_count());
+        for (std::size_t e = 0; e < graph.entry_count(); ++e) {
+            graph_hash = hash_combine(graph_hash, graph.targets()[e]);
+        }
+        for (std::size_t i = 0; i <= N; ++i) {
+            graph_hash = hash_combine(graph_hash, graph.offsets()[i]);
+        }
+        std::uint64_t states_hash = 0;
+        for (std::size_t i = 0; i < N; ++i) {
+            states_hash = hash_combine(states_hash, static_cast<std::uint64_t>(realization.initial_states[i]));
+        }
+        fingerprint << " graph " << graph_hash << " states " << states_hash;
+    }
+    if (resume && checkpoint.settings != fingerprint.str()) {
+        std::cerr << "The checkpoint was saved with different options." << std::endl;
+        return -1;
+    }
+
+    std::unique_ptr<checkpointer_t> checkpointer;
+    if (checkpoint_interval > 0.) {
+        checkpointer.reset(new checkpointer_t(*writer, checkpoint_path, fingerprint.str(), seed, checkpoint_interval, omp_get_max_threads()));
+    }
 
-        while (time < step_count) {
-            if (states.all()) {
-                // if all nodes are passive then break simulation.
-                break;
+    const std::vector<double>& time_grid = settings.time_grid;
+    const time_binning_t binning = gillespie ? time_binning_t::dense(time_grid.size())
+                                             : 0 == bins_per_decade ? time_binning_t::dense(step_count)
+                                                                    : time_binning_t::logarithmic(step_count, bins_per_decade);
+
+    model_parameters_t model_parameters;
+    model_parameters.mu_ = mu;
+    model_parameters.lambda_ = lambdas.front();
+    model_parameters.alpha_ = alpha;
+    model_parameters.step_count_ = step_count;
+    const std::size_t activity_node_count = node_activity ? realizations.front().graph.node_count() : 0;
+    std::vector<lambda_statistics_t> statistics(lambdas.size(), lambda_statistics_t(binning, observer_settings, activity_node_count));
+
+    // time written for bin i of the averaged trajectory
+    auto bin_time = [&](std::size_t i) {
+        return gillespie ? time_grid[i] : binning.is_dense() ? static_cast<double>(i) : binning.center(i);
+    };
+
+    // decay exponent per lambda, fitted after every batch of repetitions
+    std::vector<decay_exponent_t> exponents;
+    if (exponent_tolerance > 0.) {
+        const double end_time = gillespie ? max_time : static_cast<double>(step_count);
+        double window_min = end_time / 100.;
+        double window_max = end_time;
+        if (vm.count("exponent_window")) {
+            std::size_t colon = exponent_window.find(':');
+            try {
+                window_min = std::stod(exponent_window.substr(0, colon));
+                window_max = std::stod(exponent_window.substr(colon + 1));
+            } catch (std::exception&) {
+                colon = std::string::npos;
             }
+            if (std::string::npos == colon || window_min <= 0. || window_max <= window_min) {
+                std::cerr << "Invalid exponent window." << std::endl;
+                return -1;
+            }
+        }
+        std::vector<double> bin_times(binning.size());
+        for (std::size_t i = 0; i < bin_times.size(); ++i) {
+            bin_times[i] = bin_time(i);
+        }
+        exponents.assign(lambdas.size(), decay_exponent_t(bin_times, window_min, window_max));
+    }
 
-            if (0 < time && 0 == time % cache_size) {
-                std::cout << "rep = " << r << "; lambda = " << lambda << "; time = " << time << std::endl;
-                if (keep_intermediate_output) {
-                    for (std::size_t i = 0; i < cache_size; ++i) {
-                        fout << time - cache_size + i << " " << points[i] << "\n";
-                    }
+    const checkpoint_t* resumed = resume ? &checkpoint : nullptr;
+    try {
+        std::unique_ptr<telemetry_reporter_t> telemetry;
+#ifdef SIMULATOR_TELEMETRY
+        if (telemetry_interval > 0.) {
+            telemetry.reset(new telemetry_reporter_t(omp_get_max_threads(), telemetry_interval, telemetry_path));
+        }
+#endif
+        // the model is chosen once; everything below simulate_all is compiled per model
+        auto simulate = [&](const std::vector<double>& some_lambdas, std::size_t first_repetition, std::size_t count, std::vector<lambda_statistics_t>& some_statistics) {
+            if (model == "A") {
+                simulate_all<model_a_t>(model_parameters, some_lambdas, first_repetition, count, realizations, binning, observer_settings, activity_node_count, some_statistics, checkpointer.get(), resumed, telemetry.get());
+            } else if (model == "B") {
+                simulate_all<model_b_t>(model_parameters, some_lambdas, first_repetition, count, realizations, binning, observer_settings, activity_node_count, some_statistics, checkpointer.get(), resumed, telemetry.get());
+            } else {
+                simulate_all<model_cp_t>(model_parameters, some_lambdas, first_repetition, count, realizations, binning, observer_settings, activity_node_count, some_statistics, checkpointer.get(), resumed, telemetry.get());
+            }
+        };
+
+        if (exponents.empty()) {
+            simulate(lambdas, 0, repetition_count, statistics);
+        }
+        // batches of repetitions for the lambdas whose exponent is not yet within the tolerance
+        std::vector<std::size_t> open;
+        for (std::size_t l = 0; l < exponents.size(); ++l) {
+            open.emplace_back(l);
+        }
+        for (std::size_t first = 0; first < repetition_count && !open.empty(); first += repetition_batch) {
+            const std::size_t count = std::min(repetition_batch, repetition_count - first);
+            std::vector<double> batch_lambdas;
+            for (std::size_t l : open) {
+                batch_lambdas.emplace_back(lambdas[l]);
+            }
+            std::vector<lambda_statistics_t> batch_statistics(open.size(), lambda_statistics_t(binning, observer_settings, activity_node_count));
+            simulate(batch_lambdas, first, count, batch_statistics);
+
+            std::vector<std::size_t> still_open;
+            for (std::size_t i = 0; i < open.size(); ++i) {
+                const std::size_t l = open[i];
+                exponents[l].add_batch(batch_statistics[i].density_, binning, batch_statistics[i].absorption_.repetitions_);
+                statistics[l].merge(batch_statistics[i]);
+                std::cout << "lambda = " << lambdas[l] << "; repetitions = " << first + count << "; decay exponent = " << exponents[l].exponent() << " +- " << exponents[l].error() << std::endl;
+                if (!(exponents[l].error() <= exponent_tolerance)) {
+                    still_open.emplace_back(l);
                 }
-                std::vector<long double>(cache_size).swap(points);
             }
+            open.swap(still_open);
+        }
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
 
-            std::size_t passive_count = states.count();
-            points[time % cache_size] = (N - passive_count) / static_cast<long double>(N);
-#pragma omp critical
-            {
-                averaged_points[time] += points[time % cache_size];
+    if (writer) {
+        writer->flush();
+        if (writer->failed()) {
+            if (keep_intermediate_output) {
+                std::cerr << "Cannot write trajectory files." << std::endl;
+                return -1;
             }
+            std::cerr << "Cannot write checkpoint file." << std::endl;
+        }
+    }
 
-            std::vector<std::size_t> active_nodes;
-            for (std::size_t i = 0; i < N; i++) {
-                if (!states[i]) {
-                    active_nodes.emplace_back(i);
+    // every repetition on every realization is one sample of the averages; with an
+    // exponent tolerance, the lambdas may end up with different sample counts
+    if (repetition_count * realizations.size() > 1) {
+        for (std::size_t l = 0; l < lambdas.size(); ++l) {
+            const std::size_t sample_count = statistics[l].absorption_.repetitions_;
+            const trajectory_accumulator_t& averaged_points = statistics[l].density_;
+            std::stringstream final_file_name;
+            final_file_name << output_folder << "/result_" << lambdas[l] << "_final.txt";
+            std::ofstream final_file(final_file_name.str());
+            if (!final_file.is_open()) {
+                std::cerr << "Cannot create output file." << std::endl;
+                return -1;
+            }
+            // the accumulator ends at the last bin reached, so the cut-off below only
+            // drops bins where every sample had died out
+            for (std::size_t i = 0; i < averaged_points.size(); ++i) {
+                double value = averaged_points.mean(i, sample_count);
+                if ((value - 0.0) < 10e-10) {
+                    break;
                 }
+                final_file << bin_time(i) << " " << value << " " << averaged_points.standard_error(i, sample_count) << "\n";
             }
-            std::uniform_int_distribution<std::size_t> uid{ 0, active_nodes.size() - 1 };
-            std::size_t node = active_nodes[uid(gen)];
-
-            if (1 == bernoulli_deactivation(gen)) {
-                // deactivate node
-                states[node] = true;
-            } else {
-                // based upon model, activate one random inactive neighbour or all inactive neighbours and deactivate self
-                std::vector<std::size_t> inactive_neighbours;
-                for (std::size_t i : adj[node]) {
-                    if (states[i]) {
-                        inactive_neighbours.emplace_back(i);
-                    }
+            final_file.close();
+
+            // spreading observables: P(t) and the density of surviving samples
+            const absorption_statistics_t& absorption = statistics[l].absorption_;
+            std::stringstream survival_file_name;
+            survival_file_name << output_folder << "/result_" << lambdas[l] << "_survival.txt";
+            std::ofstream survival_file(survival_file_name.str());
+            if (!survival_file.is_open()) {
+                std::cerr << "Cannot create output file." << std::endl;
+                return -1;
+            }
+            survival_file << "# repetitions " << absorption.repetitions_ << "\n"
+                          << "# survived " << absorption.survived_ << "\n"
+                          << "# mean_survival_time " << absorption.mean_survival_time() << "\n"
+                          << "# mean_distinct_activated " << absorption.mean_distinct_activated() << "\n";
+            if (!exponents.empty()) {
+                survival_file << "# decay_exponent " << exponents[l].exponent() << "\n"
+                              << "# decay_exponent_error " << exponents[l].error() << "\n";
+            }
+            survival_file << "# time survival_probability surviving_density\n";
+            const trajectory_accumulator_t& survival = statistics[l].survival_;
+            for (std::size_t i = 0; i < survival.size(); ++i) {
+                double probability = survival.mean(i, sample_count);
+                if (probability <= 0.) {
+                    break;
                 }
-                perform_propagation(inactive_neighbours, states);
+                survival_file << bin_time(i) << " " << probability << " " << statistics[l].surviving_density(i, sample_count) << "\n";
+            }
+            survival_file.close();
+        }
+    }
+
+    // online observers, in the formats of distribution_calculator and autocorrelation
+    for (std::size_t l = 0; l < lambdas.size() && observer_settings.enabled(); ++l) {
+        const density_observers_t& observers = statistics[l].observers_;
+        std::stringstream prefix;
+        prefix << output_folder << "/result_" << lambdas[l];
+        if (observer_settings.histogram_bin > 0.) {
+            std::ofstream histogram_file(prefix.str() + "_histogram.txt");
+            if (!histogram_file.is_open()) {
+                std::cerr << "Cannot create output file." << std::endl;
+                return -1;
             }
-            ++time;
+            write_histograms(histogram_file, std::vector<histogram_t>(1, observers.histogram_));
+            histogram_file.close();
         }
-        if (keep_intermediate_output) {
-            for (size_t i = 0; i < cache_size; ++i) {
-                fout << time - cache_size + i << " " << points[i] << "\n";
+        if (observer_settings.correlator_points > 0) {
+            std::ofstream autocorrelation_file(prefix.str() + "_autocorrelation.txt");
+            if (!autocorrelation_file.is_open()) {
+                std::cerr << "Cannot create output file." << std::endl;
+                return -1;
+            }
+            observers.correlator_.write(autocorrelation_file);
+            autocorrelation_file.close();
+        }
+        if (observer_settings.moments) {
+            std::ofstream moments_file(prefix.str() + "_moments.txt");
+            if (!moments_file.is_open()) {
+                std::cerr << "Cannot create output file." << std::endl;
+                return -1;
+            }
+            moments_file << "# samples mean variance\n"
+                         << observers.moments_.count() << " " << observers.moments_.mean() << " " << observers.moments_.variance() << "\n";
+            moments_file.close();
+        }
+    }
+
+    if (node_activity) {
+        // per-node and per-block activity; the blocks follow the HMN hierarchy if it is given
+        const std::vector<std::size_t> block_sizes = hmn_block_sizes(activity_node_count, vm.count("hmn_b") ? hmn_parameters.b : 0, vm.count("hmn_M_0") ? hmn_parameters.M0 : 0);
+        const double observed_time = gillespie ? time_grid.back() : static_cast<double>(step_count);
+        for (std::size_t l = 0; l < lambdas.size(); ++l) {
+            std::stringstream activity_file_name;
+            activity_file_name << output_folder << "/result_" << lambdas[l] << "_activity.bin";
+            node_activity_header_t header = node_activity_header_t::make(gillespie ? node_activity_header_t::continuous : node_activity_header_t::steps, activity_node_count,
+                lambdas[l], mu, model, seed, statistics[l].absorption_.repetitions_, observed_time, block_sizes.size());
+            try {
+                write_node_activity(activity_file_name.str(), header, statistics[l].node_activity_, block_sizes);
+            } catch (std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return -1;
             }
-            fout.close();
         }
     }
 
-    if (repetition_count > 1) {
-        std::stringstream final_file_name;
-        final_file_name << output_folder << "/result_" << lambda << "_final.txt";
-        std::ofstream final_file(final_file_name.str());
-        if (!final_file.is_open()) {
+    if (lambdas.size() > 1) {
+        // density at the end of the simulated time and absorption summary for every lambda
+        std::ofstream summary_file(output_folder + "/result_summary.txt");
+        if (!summary_file.is_open()) {
             std::cerr << "Cannot create output file." << std::endl;
             return -1;
         }
-        for (std::size_t i = 0; i < step_count; ++i) {
-            averaged_points[i] /= repetition_count;
-            if ((averaged_points[i] - 0.0) < 10e-10) {
-                break;
+        summary_file << "# lambda final_density survival_probability mean_survival_time mean_distinct_activated" << (exponents.empty() ? "" : " repetitions decay_exponent decay_exponent_error") << "\n";
+        for (std::size_t l = 0; l < lambdas.size(); ++l) {
+            const trajectory_accumulator_t& points = statistics[l].density_;
+            const absorption_statistics_t& absorption = statistics[l].absorption_;
+            double final_density = points.size() == binning.size() ? points.mean(binning.size() - 1, absorption.repetitions_) : 0.;
+            summary_file << lambdas[l] << " " << final_density << " " << absorption.survival_probability() << " "
+                         << absorption.mean_survival_time() << " " << absorption.mean_distinct_activated();
+            if (!exponents.empty()) {
+                summary_file << " " << absorption.repetitions_ << " " << exponents[l].exponent() << " " << exponents[l].error();
             }
-            final_file << i << " " << averaged_points[i] << "\n";
-        }
-        /*
-        // compute average over all repetitions
-        std::vector<std::pair<std::size_t, long double>> points;
-        std::vector<std::ifstream> files;
-        for (std::size_t r = 0; r < repetition_count; ++r) {
-            files.emplace_back(std::move(std::ifstream(output_file_names[r])));
-        }
-        boost::dynamic_bitset<> file_eofs(repetition_count);
-        while (!file_eofs.all()) {
-            // read single line from all files
-            std::size_t step = 0;
-            std::vector<long double> values(repetition_count, 0.0L);
-            for (std::size_t r = 0; r < repetition_count; ++r) {
-                if(files[r] && !files[r].eof()) {
-                    files[r] >> step >> values[r];
-                } else {
-                    file_eofs[r] = true;
-                    if(file_eofs.all()) {
-                        break;
-                    }
-                }
-            }
-            long double result = std::accumulate(values.begin(), values.end(), 0.0L) / repetition_count;
-            final_file << step << " " << result << "\n";
-        }*/
-        final_file.close();
+            summary_file << "\n";
+        }
+        summary_file.close();
+    }
+
+    if (qs_history > 0) {
+        // quasi-stationary density, moment ratio and lifetime for every lambda
+        std::ofstream qs_file(output_folder + "/result_quasi_stationary.txt");
+        if (!qs_file.is_open()) {
+            std::cerr << "Cannot create output file." << std::endl;
+            return -1;
+        }
+        qs_file << "# lambda density density_error moment_ratio lifetime absorptions averaged_time\n";
+        for (std::size_t l = 0; l < lambdas.size(); ++l) {
+            const quasi_stationary_statistics_t& qs = statistics[l].quasi_stationary_;
+            qs_file << lambdas[l] << " " << qs.density() << " " << qs.density_error() << " " << qs.moment_ratio() << " " << qs.lifetime() << " "
+                    << qs.absorptions_ << " " << qs.time_ << "\n";
+        }
+        qs_file.close();
+    }
+
+    // the results are complete, so the checkpoint is of no further use
+    if (checkpointer || resume) {
+        boost::system::error_code error;
+        fs::remove(checkpoint_path, error);
     }
 
     return 0;
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "active_set.hpp"
+#include "csr_graph.hpp"
+#include "random.hpp"
+#include "replica_states.hpp"
+
+struct model_parameters_t
+{
+    double mu_;
+    double lambda_;
+    double alpha_;
+    std::size_t step_count_;
+};
+
+// Common part of the propagation models: every event on an active node is a
+// deactivation with probability mu / (lambda + mu), otherwise a propagation
+// step defined by the model policy deriving from model_t.
+//
+// A policy provides, for a node that does not deactivate,
+//   propagate(gen, node, graph, active, scratch)
+// for the single replica engines and
+//   propagate(gen, node, replicas, graph, states, scratch)
+// for the multispin engine, where 'replicas' are the replicas the node
+// propagates in. Policies are template arguments of model_simulator_t, so
+// the step loop is compiled once per model without virtual calls.
+class model_t
+{
+public:
+    explicit model_t(const model_parameters_t& parameters)
+        : parameters_(parameters)
+        , deactivation_(0.)
+        , propagation_(0.)
+        , deactivation_mask_(0.)
+        , propagation_mask_(0.)
+    {
+        set_lambda(parameters.lambda_);
+    }
+
+    const model_parameters_t& parameters() const
+    {
+        return parameters_;
+    }
+
+    void set_lambda(double lambda)
+    {
+        parameters_.lambda_ = lambda;
+        const double mu = parameters_.mu_;
+        deactivation_ = bernoulli_t(mu / (lambda + mu));
+        propagation_ = bernoulli_t(lambda / (lambda + mu));
+        deactivation_mask_ = bernoulli_mask_t(mu / (lambda + mu));
+        propagation_mask_ = bernoulli_mask_t(lambda / (lambda + mu));
+    }
+
+    template <class engine_t>
+    bool deactivates(engine_t& gen) const
+    {
+        return deactivation_(gen);
+    }
+
+    // Replicas, among 64, in which the node deactivates.
+    template <class engine_t>
+    replica_mask_t deactivates_mask(engine_t& gen) const
+    {
+        return deactivation_mask_(gen);
+    }
+
+protected:
+    model_parameters_t parameters_;
+    bernoulli_t deactivation_; // the probability of the node deactivation reaction.
+    bernoulli_t propagation_; // the probability of activity propagation reaction.
+    bernoulli_mask_t deactivation_mask_;
+    bernoulli_mask_t propagation_mask_;
+};
+
+// Model A: activate one random inactive neighbour of the node.
+class model_a_t : public model_t
+{
+public:
+    model_a_t(const model_parameters_t& parameters, const csr_graph_t&)
+        : model_t(parameters)
+    {
+    }
+
+    template <class engine_t>
+    void propagate(engine_t& gen, node_t node, const csr_graph_t& graph, active_set_t& active, std::vector<node_t>& inactive_neighbours) const
+    {
+        inactive_neighbours.clear();
+        for (node_t i : graph.neighbours(node)) {
+            if (!active.is_active(i)) {
+                inactive_neighbours.emplace_back(i);
+            }
+        }
+        if (!inactive_neighbours.empty()) {
+            active.activate(inactive_neighbours[uniform_index(gen, inactive_neighbours.size())]);
+        }
+    }
+
+    template <class engine_t>
+    void propagate(engine_t& gen, node_t node, replica_mask_t replicas, const csr_graph_t& graph, replica_states_t& states, std::vector<node_t>& order) const
+    {
+        // the first inactive neighbour in a uniformly random order is a uniformly chosen
+        // inactive neighbour in every replica; the order is only drawn as far as needed
+        csr_graph_t::neighbour_range_t neighbours = graph.neighbours(node);
+        order.assign(neighbours.begin(), neighbours.end());
+        for (std::size_t j = 0; j < order.size() && replicas; ++j) {
+            std::swap(order[j], order[j + uniform_index(gen, order.size() - j)]);
+            replica_mask_t activated = replicas & ~states.active(order[j]);
+            states.activate(order[j], activated);
+            replicas &= ~activated;
+        }
+    }
+};
+
+// Model B: activate every inactive neighbour with propagation probability and deactivate the node itself.
+class model_b_t : public model_t
+{
+public:
+    model_b_t(const model_parameters_t& parameters, const csr_graph_t&)
+        : model_t(parameters)
+    {
+    }
+
+    template <class engine_t>
+    void propagate(engine_t& gen, node_t node, const csr_graph_t& graph, active_set_t& active, std::vector<node_t>& inactive_neighbours) const
+    {
+        inactive_neighbours.clear();
+        for (node_t i : graph.neighbours(node)) {
+            if (!active.is_active(i)) {
+                inactive_neighbours.emplace_back(i);
+            }
+        }
+        for (std::size_t y = 0; y < inactive_neighbours.size(); ++y) {
+            if (propagation_(gen)) {
+                active.activate(inactive_neighbours[y]);
+            }
+        }
+        active.deactivate(node);
+    }
+
+    template <class engine_t>
+    void propagate(engine_t& gen, node_t node, replica_mask_t replicas, const csr_graph_t& graph, replica_states_t& states, std::vector<node_t>&) const
+    {
+        for (node_t i : graph.neighbours(node)) {
+            replica_mask_t inactive = replicas & ~states.active(i);
+            if (inactive) {
+                states.activate(i, inactive & propagation_mask_(gen));
+            }
+        }
+        states.deactivate(node, replicas);
+    }
+};
+
+// Contact process with degree-weighted edges: the node picks one neighbour j with
+// probability proportional to k_j^alpha and activates it if it is inactive. alpha = 0
+// is the plain contact process; unlike model A, active neighbours are also picked.
+class model_cp_t : public model_t
+{
+public:
+    model_cp_t(const model_parameters_t& parameters, const csr_graph_t& graph)
+        : model_t(parameters)
+    {
+        if (0. != parameters.alpha_) {
+            // cumulative neighbour weights per adjacency row, shared by the copies for other lambdas
+            std::shared_ptr<std::vector<double> > weights = std::make_shared<std::vector<double> >(graph.entry_count());
+            const node_t* targets = graph.targets();
+            for (std::size_t i = 0; i < graph.node_count(); ++i) {
+                double sum = 0.;
+                for (std::size_t e = graph.offsets()[i]; e < graph.offsets()[i + 1]; ++e) {
+                    sum += std::pow(static_cast<double>(graph.degree(targets[e])), parameters.alpha_);
+                    (*weights)[e] = sum;
+                }
+            }
+            cumulative_weights_ = weights;
+        }
+    }
+
+    template <class engine_t>
+    void propagate(engine_t& gen, node_t node, const csr_graph_t& graph, active_set_t& active, std::vector<node_t>&) const
+    {
+        if (!graph.neighbours(node).empty()) {
+            active.activate(pick(gen, node, graph));
+        }
+    }
+
+    // All propagating replicas pick the same neighbour; each of them sees the right choice distribution.
+    template <class engine_t>
+    void propagate(engine_t& gen, node_t node, replica_mask_t replicas, const csr_graph_t& graph, replica_states_t& states, std::vector<node_t>&) const
+    {
+        if (!graph.neighbours(node).empty()) {
+            states.activate(pick(gen, node, graph), replicas);
+        }
+    }
+
+private:
+    template <class engine_t>
+    node_t pick(engine_t& gen, node_t node, const csr_graph_t& graph) const
+    {
+        csr_graph_t::neighbour_range_t neighbours = graph.neighbours(node);
+        if (!cumulative_weights_) {
+            return neighbours[uniform_index(gen, neighbours.size())];
+        }
+        const double* first = cumulative_weights_->data() + graph.offsets()[node];
+        const double* last = first + neighbours.size();
+        const double* chosen = std::upper_bound(first, last, uniform_real(gen) * last[-1]);
+        return neighbours[std::min<std::size_t>(chosen - first, neighbours.size() - 1)];
+    }
+
+    std::shared_ptr<const std::vector<double> > cumulative_weights_;
+};
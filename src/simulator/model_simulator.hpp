@@ -0,0 +1,399 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/dynamic_bitset.hpp>
+
+#include "active_set.hpp"
+#include "async_writer.hpp"
+#include "binary_io.hpp"
+#include "checkpoint.hpp"
+#include "csr_graph.hpp"
+#include "model.hpp"
+#include "random.hpp"
+#include "replica_states.hpp"
+#include "state_history.hpp"
+#include "statistics.hpp"
+#include "telemetry.hpp"
+#include "trajectory_writer.hpp"
+
+// Settings shared by all simulated repetitions.
+struct simulation_settings_t
+{
+    std::string engine;
+    std::string model;
+    std::vector<double> time_grid; // sampling times of the continuous time engines
+    bool keep_intermediate_output;
+    std::string output_folder;
+    std::uint64_t seed;
+    async_writer_t* writer; // set when per-repetition trajectories are kept
+    // quasi-stationary method (discrete and gillespie engines): size of the state history,
+    // 0 to end repetitions on absorption; time between snapshots and relaxation time
+    // before the averages, in steps or in physical time
+    std::size_t qs_history = 0;
+    double qs_snapshot_interval = 0.;
+    double qs_relaxation = 0.;
+    // network file id of every internal node id when the nodes were reordered, else null
+    const node_t* original_ids = nullptr;
+};
+
+// Random stream of repetition r at the given lambda. It does not depend on the other
+// lambdas of a sweep or on the thread that runs the repetition.
+inline std::uint64_t stream_id(double lambda, std::size_t r)
+{
+    return hash_combine(hash_double(lambda), r);
+}
+
+// Simulation core for one model policy (see model_t) and random engine. The
+// model is fixed at compile time, so the step loops below contain no virtual
+// calls or model checks.
+template <class model_type, class engine_t>
+class model_simulator_t
+{
+public:
+    model_simulator_t(const model_type& model, const simulation_settings_t& settings, const csr_graph_t& graph, const boost::dynamic_bitset<>& initial_states)
+        : model_(model)
+        , parameters_(model.parameters())
+        , settings_(settings)
+        , graph_(graph)
+        , initial_states_(initial_states)
+    {
+    }
+
+    // Runs repetition r of the model and adds its density trajectory and absorbing-state
+    // observables to statistics, which must only hold this task. With a state history
+    // (quasi-stationary method), an absorbed repetition continues from one of its recent
+    // configurations instead, and the time averages after the relaxation time and the
+    // absorptions go to the quasi-stationary statistics. If the statistics track node
+    // activity, every activation and deactivation is reported to them, but not the nodes
+    // of a restored configuration. The state of the repetition is saved to the checkpoint
+    // as the task when it is due; saved_state, if given, is such a state to continue from.
+    void simulate(std::size_t r, lambda_statistics_t& statistics, thread_checkpoint_t& checkpoint, std::uint64_t task, const std::vector<char>* saved_state)
+    {
+        const double lambda = parameters_.lambda_;
+        const double mu = parameters_.mu_;
+        const std::vector<double>& time_grid = settings_.time_grid;
+
+        engine_t gen = make_stream<engine_t>(settings_.seed, stream_id(lambda, r));
+
+        std::unique_ptr<trajectory_writer_t> trajectory;
+        if (settings_.keep_intermediate_output) {
+            std::stringstream name;
+            name << settings_.output_folder << "/result_" << lambda << "_" << r << ".trj";
+            trajectory_header_t header = trajectory_header_t::make(settings_.engine == "gillespie" ? trajectory_header_t::continuous : trajectory_header_t::steps,
+                graph_.node_count(), lambda, mu, settings_.model, settings_.seed, r);
+            trajectory.reset(new trajectory_writer_t(*settings_.writer, name.str(), header));
+            if (!trajectory->is_open()) {
+#pragma omp critical
+                std::cerr << "Cannot create output file " << name.str() << "." << std::endl;
+                trajectory.reset();
+            }
+        }
+
+        active_set_t active(initial_states_);
+        std::uint64_t step = 0; // time step, or next grid point of the continuous time engines
+        double t = 0.;
+        const bool quasi_stationary = settings_.qs_history > 0;
+        state_history_t history(settings_.qs_history);
+        if (saved_state) {
+            binary_reader_t in(saved_state->data(), saved_state->data() + saved_state->size());
+            load_state(in, gen, active, step, t, statistics);
+            if (quasi_stationary) {
+                history.load(in, graph_.node_count());
+            }
+            if (!in.at_end()) {
+                throw std::runtime_error("Invalid checkpoint data.");
+            }
+        } else {
+            statistics.begin_repetition();
+        }
+        node_activity_t& activity = statistics.node_activity_;
+        if (activity.enabled()) {
+            activity.bind(settings_.original_ids);
+            if (!saved_state) {
+                activity.begin_repetition(active.nodes(), 0.);
+            }
+            active.track(&activity);
+        }
+        const auto save = [&](binary_writer_t& out) {
+            save_state(out, gen, active, step, t, statistics);
+            if (quasi_stationary) {
+                history.save(out);
+            }
+        };
+        telemetry_probe_t probe;
+        quasi_stationary_statistics_t& qs = statistics.quasi_stationary_;
+
+        if (settings_.engine == "gillespie") {
+            // total event rate is (mu + lambda) per active node; the event itself is chosen as in the discrete engine
+            const double total_rate = mu + lambda;
+            const double end_time = time_grid.empty() ? 0. : time_grid.back();
+            std::uint64_t& k = step;
+            // snapshots are taken at the first event past every multiple of the interval
+            double next_snapshot = quasi_stationary ? (std::floor(t / settings_.qs_snapshot_interval) + 1.) * settings_.qs_snapshot_interval : 0.;
+            for (std::size_t event = 0;; ++event) {
+                if (active.empty() && !reactivate(gen, active, history, qs, activity, t >= settings_.qs_relaxation)) {
+                    break;
+                }
+                if (0 == (event & checkpoint_mask) && checkpoint.due()) {
+                    checkpoint.save(task, save);
+                }
+                probe.step(active.size());
+                const double previous_t = t;
+                t += exponential(gen) / (total_rate * active.size());
+                probe.mark(telemetry_sampling);
+                // the state before this event holds on all grid points up to t
+                long double density = active.density();
+                for (; k < time_grid.size() && time_grid[k] < t; ++k) {
+                    statistics.add(k, density);
+                    if (trajectory) {
+                        trajectory->append(time_grid[k], active.size());
+                    }
+                }
+                if (quasi_stationary) {
+                    const double averaged = std::min(t, end_time) - std::max(previous_t, settings_.qs_relaxation);
+                    if (averaged > 0.) {
+                        qs.add(averaged, density);
+                    }
+                    if (t >= next_snapshot) {
+                        history.push(active);
+                        next_snapshot = (std::floor(t / settings_.qs_snapshot_interval) + 1.) * settings_.qs_snapshot_interval;
+                    }
+                }
+                probe.mark(telemetry_output);
+                if (k == time_grid.size()) {
+                    break;
+                }
+                if (activity.enabled()) {
+                    activity.set_time(t);
+                }
+                perform_event(gen, active, probe);
+            }
+            if (activity.enabled()) {
+                activity.end_repetition(active.nodes(), std::min(t, end_time));
+            }
+            statistics.end_repetition();
+            statistics.absorption_.add(!active.empty(), t, active.ever_active_count());
+            return;
+        }
+
+        std::uint64_t& time = step;
+        const std::size_t progress_interval = 100000;
+        const std::uint64_t snapshot_interval = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(settings_.qs_snapshot_interval));
+        const double relaxation = settings_.qs_relaxation;
+
+        while (time < parameters_.step_count_) {
+            if (active.empty() && !reactivate(gen, active, history, qs, activity, time >= relaxation)) {
+                // if all nodes are passive then break simulation.
+                break;
+            }
+
+            if (0 == (time & checkpoint_mask) && checkpoint.due()) {
+                checkpoint.save(task, save);
+            }
+
+            // superseded by the telemetry reports when they are compiled in; written as one
+            // unflushed line so the lines of different threads do not interleave
+            if (!telemetry_compiled && 0 < time && 0 == time % progress_interval) {
+                std::ostringstream progress;
+                progress << "rep = " << r << "; lambda = " << lambda << "; time = " << time << "\n";
+                std::cout << progress.str();
+            }
+
+            probe.step(active.size());
+            statistics.add(time, active.density());
+            if (trajectory) {
+                trajectory->append(active.size());
+            }
+            if (quasi_stationary) {
+                if (time >= relaxation) {
+                    qs.add(1., active.density());
+                }
+                if (0 == time % snapshot_interval) {
+                    history.push(active);
+                }
+            }
+            probe.mark(telemetry_output);
+
+            // the changes of this step hold from the next one on
+            if (activity.enabled()) {
+                activity.set_time(time + 1);
+            }
+            perform_event(gen, active, probe);
+            ++time;
+        }
+        if (activity.enabled()) {
+            activity.end_repetition(active.nodes(), time);
+        }
+        statistics.end_repetition();
+        statistics.absorption_.add(!active.empty(), time, active.ever_active_count());
+    }
+
+    // Runs repetitions first..first+count-1 (count <= 64) as bit-parallel replicas in
+    // continuous time. Nodes of the union of active nodes fire at rate mu + lambda and only
+    // the replicas in which the node is active react, so every replica follows the
+    // dynamics of the gillespie engine. Replicas of a block share event times and node
+    // choices: averages are unbiased, but the repetitions of a block are not independent.
+    // Statistics and checkpoints are handled as in simulate().
+    void simulate_replicas(std::size_t first, std::size_t count, lambda_statistics_t& statistics, thread_checkpoint_t& checkpoint, std::uint64_t task,
+        const std::vector<char>* saved_state)
+    {
+        const double lambda = parameters_.lambda_;
+        const double mu = parameters_.mu_;
+        const std::vector<double>& time_grid = settings_.time_grid;
+        const long double N = graph_.node_count();
+
+        engine_t gen = make_stream<engine_t>(settings_.seed, stream_id(lambda, first));
+
+        const replica_mask_t replicas = count == replica_states_t::width ? ~replica_mask_t(0) : (replica_mask_t(1) << count) - 1;
+        replica_states_t states(initial_states_, replicas);
+        std::vector<double> absorption_time(replica_states_t::width, 0.);
+        std::uint64_t k = 0;
+        double t = 0.;
+        if (saved_state) {
+            binary_reader_t in(saved_state->data(), saved_state->data() + saved_state->size());
+            load_state(in, gen, states, k, t, statistics);
+            in.read(absorption_time);
+            if (absorption_time.size() != replica_states_t::width || !in.at_end()) {
+                throw std::runtime_error("Invalid checkpoint data.");
+            }
+        } else {
+            statistics.begin_repetition(count);
+        }
+
+        const double total_rate = mu + lambda;
+        telemetry_probe_t probe;
+        for (std::size_t event = 0; !states.empty(); ++event) {
+            if (0 == (event & checkpoint_mask) && checkpoint.due()) {
+                checkpoint.save(task, [&](binary_writer_t& out) {
+                    save_state(out, gen, states, k, t, statistics);
+                    out.write(absorption_time);
+                });
+            }
+            probe.step(states.size());
+            t += exponential(gen) / (total_rate * states.size());
+            probe.mark(telemetry_sampling);
+            for (; k < time_grid.size() && time_grid[k] < t; ++k) {
+                for (replica_mask_t m = states.alive(); m; m &= m - 1) {
+                    statistics.add(k, states.count(__builtin_ctzll(m)) / N);
+                }
+            }
+            probe.mark(telemetry_output);
+            if (k == time_grid.size()) {
+                break;
+            }
+            replica_mask_t alive = states.alive();
+            perform_event(gen, states, probe);
+            for (replica_mask_t m = alive & ~states.alive(); m; m &= m - 1) {
+                absorption_time[__builtin_ctzll(m)] = t;
+            }
+        }
+        statistics.end_repetition();
+        for (std::size_t b = 0; b < count; ++b) {
+            bool survived = states.count(b) > 0;
+            statistics.absorption_.add(survived, survived ? t : absorption_time[b], states.ever_active_count(b));
+        }
+    }
+
+private:
+    // Checkpoints are only considered every checkpoint_mask + 1 steps or events.
+    static constexpr std::size_t checkpoint_mask = 4095;
+
+    // State of a running repetition: random engine, node states, step or grid point
+    // counter, time and the repetition's statistics.
+    template <class states_t>
+    static void save_state(binary_writer_t& out, const engine_t& gen, const states_t& states, std::uint64_t step, double t, const lambda_statistics_t& statistics)
+    {
+        std::ostringstream engine;
+        engine << gen;
+        out.write(engine.str());
+        states.save(out);
+        out.write(step);
+        out.write(t);
+        statistics.save(out);
+        statistics.save_repetition(out);
+    }
+
+    template <class states_t>
+    static void load_state(binary_reader_t& in, engine_t& gen, states_t& states, std::uint64_t& step, double& t, lambda_statistics_t& statistics)
+    {
+        std::string engine_state;
+        in.read(engine_state);
+        std::istringstream engine(engine_state);
+        engine >> gen;
+        if (!engine) {
+            throw std::runtime_error("Invalid checkpoint data.");
+        }
+        states.load(in);
+        in.read(step);
+        in.read(t);
+        statistics.load(in);
+        statistics.load_repetition(in);
+    }
+
+    // Continues an absorbed repetition from its state history, if it has one; absorptions
+    // after the relaxation time are counted. The activity hooks are bypassed while the
+    // configuration is restored, so its nodes count as active but not as activated.
+    static bool reactivate(engine_t& gen, active_set_t& active, const state_history_t& history, quasi_stationary_statistics_t& qs, node_activity_t& activity, bool averaging)
+    {
+        if (history.empty()) {
+            return false;
+        }
+        if (averaging) {
+            qs.absorbed();
+        }
+        active.track(nullptr);
+        history.restore(gen, active);
+        if (activity.enabled()) {
+            activity.restored(active.nodes());
+            active.track(&activity);
+        }
+        return true;
+    }
+
+    // Single reaction on a uniformly chosen active node: either deactivation or propagation according to the model.
+    void perform_event(engine_t& gen, active_set_t& active, telemetry_probe_t& probe)
+    {
+        node_t node = active.random(gen);
+        bool deactivates = model_.deactivates(gen);
+        probe.mark(telemetry_sampling);
+        if (deactivates) {
+            active.deactivate(node);
+        } else {
+            model_.propagate(gen, node, graph_, active, scratch_);
+        }
+        probe.mark(telemetry_propagation);
+    }
+
+    // Single reaction on a node drawn from the union of the replicas' active nodes. Every
+    // replica in which the node is active reacts on its own.
+    void perform_event(engine_t& gen, replica_states_t& states, telemetry_probe_t& probe)
+    {
+        node_t node = states.random(gen);
+        replica_mask_t active = states.active(node);
+        replica_mask_t deactivated = active & model_.deactivates_mask(gen);
+        probe.mark(telemetry_sampling);
+        states.deactivate(node, deactivated);
+        replica_mask_t propagating = active & ~deactivated;
+        if (propagating) {
+            model_.propagate(gen, node, propagating, graph_, states, scratch_);
+        }
+        probe.mark(telemetry_propagation);
+    }
+
+    const model_type& model_;
+    const model_parameters_t& parameters_;
+    const simulation_settings_t& settings_;
+    const csr_graph_t& graph_;
+    const boost::dynamic_bitset<>& initial_states_;
+    std::vector<node_t> scratch_;
+};
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "binary_io.hpp"
+#include "csr_graph.hpp"
+
+// Per-node activity of one lambda, summed over repetitions: the time each node
+// was active and the number of times it was activated, as a structure of
+// arrays indexed by the node ids of the network file. The active set reports
+// every activation and deactivation of the running repetition; a node's active
+// time is added when it deactivates, or when the repetition ends. A configuration
+// restored by the quasi-stationary method is not reported as activations, see
+// restored().
+class node_activity_t
+{
+public:
+    explicit node_activity_t(std::size_t node_count = 0)
+        : active_time_(node_count, 0.)
+        , activations_(node_count, 0)
+        , since_(node_count, 0.)
+        , original_(nullptr)
+        , now_(0.)
+    {
+    }
+
+    bool enabled() const
+    {
+        return !active_time_.empty();
+    }
+
+    std::size_t node_count() const
+    {
+        return active_time_.size();
+    }
+
+    // Internal node ids of the running repetition are mapped to network file ids
+    // through original[]; null keeps them.
+    void bind(const node_t* original)
+    {
+        original_ = original;
+    }
+
+    // Starts the repetition at time now with the given internal ids active.
+    void begin_repetition(const std::vector<node_t>& active, double now)
+    {
+        now_ = now;
+        for (node_t node : active) {
+            since_[map(node)] = now;
+        }
+    }
+
+    // Time of the next activations and deactivations.
+    void set_time(double now)
+    {
+        now_ = now;
+    }
+
+    // Nodes of a configuration restored at the current time after an absorption.
+    // They are active from now on, but the restore replaces the absorbed state
+    // rather than being part of the dynamics, so no activation is counted.
+    void restored(const std::vector<node_t>& active)
+    {
+        for (node_t node : active) {
+            since_[map(node)] = now_;
+        }
+    }
+
+    void activated(node_t node)
+    {
+        node = map(node);
+        since_[node] = now_;
+        ++activations_[node];
+    }
+
+    void deactivated(node_t node)
+    {
+        node = map(node);
+        active_time_[node] += now_ - since_[node];
+    }
+
+    // Ends the repetition at time now; the nodes still active count as active up to then.
+    void end_repetition(const std::vector<node_t>& active, double now)
+    {
+        now_ = now;
+        for (node_t node : active) {
+            deactivated(node);
+        }
+    }
+
+    void merge(const node_activity_t& other)
+    {
+        for (std::size_t i = 0; i < other.active_time_.size(); ++i) {
+            active_time_[i] += other.active_time_[i];
+            activations_[i] += other.activations_[i];
+        }
+    }
+
+    void save(binary_writer_t& out) const
+    {
+        out.write(active_time_);
+        out.write(activations_);
+    }
+
+    void load(binary_reader_t& in)
+    {
+        const std::size_t node_count = active_time_.size();
+        in.read(active_time_);
+        in.read(activations_);
+        if (active_time_.size() != node_count || activations_.size() != node_count) {
+            throw std::runtime_error("Invalid checkpoint data.");
+        }
+    }
+
+    // Activation times of the running repetition.
+    void save_repetition(binary_writer_t& out) const
+    {
+        out.write(since_);
+        out.write(now_);
+    }
+
+    void load_repetition(binary_reader_t& in)
+    {
+        const std::size_t node_count = since_.size();
+        in.read(since_);
+        in.read(now_);
+        if (since_.size() != node_count) {
+            throw std::runtime_error("Invalid checkpoint data.");
+        }
+    }
+
+    const std::vector<double>& active_time() const
+    {
+        return active_time_;
+    }
+
+    const std::vector<std::uint64_t>& activations() const
+    {
+        return activations_;
+    }
+
+private:
+    node_t map(node_t node) const
+    {
+        return original_ ? original_[node] : node;
+    }
+
+    std::vector<double> active_time_;
+    std::vector<std::uint64_t> activations_;
+    std::vector<double> since_; // last activation of the running repetition
+    const node_t* original_;
+    double now_;
+};
+
+// Binary node activity file of one lambda.
+//
+// The file starts with node_activity_header_t, followed by two float arrays
+// over the nodes in network file order: the fraction of the observed time the
+// node was active and its mean number of activations per repetition. Then, for
+// each of the level_count block sizes of the module hierarchy, come the block
+// size and block count as uint64 and the same two arrays averaged over the
+// nodes of every block; block k holds the nodes [k * size, (k + 1) * size).
+// All values are native-endian.
+struct node_activity_header_t
+{
+    enum time_kind_t : std::uint32_t
+    {
+        steps = 0,
+        continuous = 1
+    };
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t time_kind;
+    std::uint64_t node_count;
+    double lambda;
+    double mu;
+    char model[8];
+    std::uint64_t seed;
+    std::uint64_t repetitions;
+    double observed_time; // simulated time of one repetition
+    std::uint64_t level_count;
+
+    static const char* expected_magic()
+    {
+        return "HMNACT\0\0";
+    }
+
+    static node_activity_header_t make(time_kind_t time_kind, std::uint64_t node_count, double lambda, double mu, const std::string& model, std::uint64_t seed, std::uint64_t repetitions,
+        double observed_time, std::uint64_t level_count)
+    {
+        node_activity_header_t header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, expected_magic(), sizeof(header.magic));
+        header.version = 1;
+        header.time_kind = time_kind;
+        header.node_count = node_count;
+        header.lambda = lambda;
+        header.mu = mu;
+        std::strncpy(header.model, model.c_str(), sizeof(header.model) - 1);
+        header.seed = seed;
+        header.repetitions = repetitions;
+        header.observed_time = observed_time;
+        header.level_count = level_count;
+        return header;
+    }
+};
+
+// Block sizes of the HMN hierarchy on node_count nodes: the modules of M0 nodes and
+// the blocks of b^l nodes below the whole network, ascending.
+inline std::vector<std::size_t> hmn_block_sizes(std::size_t node_count, std::size_t b, std::size_t M0)
+{
+    std::vector<std::size_t> sizes;
+    if (0 != M0 && M0 < node_count && 0 == node_count % M0) {
+        sizes.emplace_back(M0);
+    }
+    for (std::size_t size = b; b > 1 && size < node_count && 0 == node_count % size; size *= b) {
+        if (size != M0) {
+            sizes.emplace_back(size);
+        }
+    }
+    std::sort(sizes.begin(), sizes.end());
+    return sizes;
+}
+
+inline void write_node_activity(const std::string& path, const node_activity_header_t& header, const node_activity_t& activity, const std::vector<std::size_t>& block_sizes)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Cannot create node activity file.");
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    const std::size_t n = activity.node_count();
+    const double repetitions = header.repetitions ? static_cast<double>(header.repetitions) : 1.;
+    const double time = header.observed_time > 0. ? header.observed_time : 1.;
+    std::vector<float> fraction(n);
+    std::vector<float> activations(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        fraction[i] = static_cast<float>(activity.active_time()[i] / (repetitions * time));
+        activations[i] = static_cast<float>(activity.activations()[i] / repetitions);
+    }
+    out.write(reinterpret_cast<const char*>(fraction.data()), n * sizeof(float));
+    out.write(reinterpret_cast<const char*>(activations.data()), n * sizeof(float));
+
+    for (std::size_t size : block_sizes) {
+        const std::uint64_t block_size = size;
+        const std::uint64_t block_count = n / size;
+        std::vector<float> block_fraction(block_count);
+        std::vector<float> block_activations(block_count);
+        for (std::size_t k = 0; k < block_count; ++k) {
+            double fraction_sum = 0.;
+            double activation_sum = 0.;
+            for (std::size_t i = k * size; i < (k + 1) * size; ++i) {
+                fraction_sum += fraction[i];
+                activation_sum += activations[i];
+            }
+            block_fraction[k] = static_cast<float>(fraction_sum / size);
+            block_activations[k] = static_cast<float>(activation_sum / size);
+        }
+        out.write(reinterpret_cast<const char*>(&block_size), sizeof(block_size));
+        out.write(reinterpret_cast<const char*>(&block_count), sizeof(block_count));
+        out.write(reinterpret_cast<const char*>(block_fraction.data()), block_count * sizeof(float));
+        out.write(reinterpret_cast<const char*>(block_activations.data()), block_count * sizeof(float));
+    }
+    if (!out) {
+        throw std::runtime_error("Cannot write node activity file.");
+    }
+}
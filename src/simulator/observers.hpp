@@ -0,0 +1,363 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include "binary_io.hpp"
+#include "histogram.hpp"
+
+// Mean and variance of a stream of values (Welford), mergeable across threads.
+class running_moments_t
+{
+public:
+    running_moments_t()
+        : count_(0)
+        , mean_(0.)
+        , m2_(0.)
+    {
+    }
+
+    void add(double value)
+    {
+        ++count_;
+        double delta = value - mean_;
+        mean_ += delta / count_;
+        m2_ += delta * (value - mean_);
+    }
+
+    void merge(const running_moments_t& other)
+    {
+        if (0 == other.count_) {
+            return;
+        }
+        std::uint64_t count = count_ + other.count_;
+        double delta = other.mean_ - mean_;
+        mean_ += delta * other.count_ / count;
+        m2_ += other.m2_ + delta * delta * (static_cast<double>(count_) * other.count_ / count);
+        count_ = count;
+    }
+
+    void save(binary_writer_t& out) const
+    {
+        out.write(count_);
+        out.write(mean_);
+        out.write(m2_);
+    }
+
+    void load(binary_reader_t& in)
+    {
+        in.read(count_);
+        in.read(mean_);
+        in.read(m2_);
+    }
+
+    std::uint64_t count() const
+    {
+        return count_;
+    }
+
+    double mean() const
+    {
+        return mean_;
+    }
+
+    // Population variance, like the dispersion of the autocorrelation tool.
+    double variance() const
+    {
+        return count_ ? m2_ / count_ : 0.;
+    }
+
+private:
+    std::uint64_t count_;
+    double mean_;
+    double m2_;
+};
+
+// Multi-tau autocorrelator: level 0 correlates the last `points` samples
+// directly, every further level sees averages of sample pairs of the level
+// below and covers the lags points/2..points-1 in units of 2^level. Lags up
+// to points * 2^levels cost O(points * levels) memory and O(points) work per
+// sample. Shift registers restart with every repetition, the lag sums do not.
+class multi_tau_correlator_t
+{
+public:
+    explicit multi_tau_correlator_t(std::size_t points, std::size_t max_levels = 40)
+        : points_(points)
+        , max_levels_(max_levels)
+        , sum_(0.)
+    {
+    }
+
+    void begin_repetition()
+    {
+        for (level_t& level : levels_) {
+            level.filled = 0;
+            level.accumulated = 0;
+            level.accumulator = 0.;
+        }
+    }
+
+    void add(double value)
+    {
+        sum_ += value;
+        for (std::size_t k = 0; k < max_levels_; ++k) {
+            if (k == levels_.size()) {
+                levels_.emplace_back(points_);
+            }
+            level_t& level = levels_[k];
+            // the register is stored twice so the newest points values are contiguous
+            level.head = (0 == level.head ? points_ : level.head) - 1;
+            level.values[level.head] = level.values[level.head + points_] = value;
+            if (level.filled < points_) {
+                ++level.filled;
+            }
+            const double* window = &level.values[level.head];
+            for (std::size_t j = 0 == k ? 0 : points_ / 2; j < level.filled; ++j) {
+                level.sums[j] += value * window[j];
+                level.earlier[j] += window[j];
+                level.later[j] += value;
+                ++level.counts[j];
+            }
+            level.accumulator += value;
+            if (++level.accumulated < 2) {
+                return;
+            }
+            value = level.accumulator / 2;
+            level.accumulator = 0.;
+            level.accumulated = 0;
+        }
+    }
+
+    void merge(const multi_tau_correlator_t& other)
+    {
+        if (levels_.size() < other.levels_.size()) {
+            levels_.resize(other.levels_.size(), level_t(points_));
+        }
+        for (std::size_t k = 0; k < other.levels_.size(); ++k) {
+            for (std::size_t j = 0; j < points_; ++j) {
+                levels_[k].sums[j] += other.levels_[k].sums[j];
+                levels_[k].earlier[j] += other.levels_[k].earlier[j];
+                levels_[k].later[j] += other.levels_[k].later[j];
+                levels_[k].counts[j] += other.levels_[k].counts[j];
+            }
+        }
+        sum_ += other.sum_;
+    }
+
+    // Lag sums for checkpoints.
+    void save(binary_writer_t& out) const
+    {
+        out.write(sum_);
+        out.write(static_cast<std::uint64_t>(levels_.size()));
+        for (const level_t& level : levels_) {
+            out.write(level.sums);
+            out.write(level.earlier);
+            out.write(level.later);
+            out.write(level.counts);
+        }
+    }
+
+    void load(binary_reader_t& in)
+    {
+        std::uint64_t level_count = 0;
+        in.read(sum_);
+        in.read(level_count);
+        levels_.assign(level_count, level_t(points_));
+        for (level_t& level : levels_) {
+            in.read(level.sums);
+            in.read(level.earlier);
+            in.read(level.later);
+            in.read(level.counts);
+            check(level);
+        }
+    }
+
+    // Shift registers of the running repetition for checkpoints.
+    void save_registers(binary_writer_t& out) const
+    {
+        out.write(static_cast<std::uint64_t>(levels_.size()));
+        for (const level_t& level : levels_) {
+            out.write(level.values);
+            out.write(static_cast<std::uint64_t>(level.head));
+            out.write(static_cast<std::uint64_t>(level.filled));
+            out.write(level.accumulator);
+            out.write(static_cast<std::uint64_t>(level.accumulated));
+        }
+    }
+
+    void load_registers(binary_reader_t& in)
+    {
+        std::uint64_t level_count = 0;
+        in.read(level_count);
+        if (levels_.size() < level_count) {
+            levels_.resize(level_count, level_t(points_));
+        }
+        begin_repetition();
+        for (std::size_t k = 0; k < level_count; ++k) {
+            level_t& level = levels_[k];
+            std::uint64_t head = 0;
+            std::uint64_t filled = 0;
+            std::uint64_t accumulated = 0;
+            in.read(level.values);
+            in.read(head);
+            in.read(filled);
+            in.read(level.accumulator);
+            in.read(accumulated);
+            level.head = head;
+            level.filled = filled;
+            level.accumulated = accumulated;
+            check(level);
+        }
+    }
+
+    // Writes 't C(t)' lines like the autocorrelation tool: the mean of
+    // (x(s) - mean) (x(s + t) - mean) over the pairs of lag t, divided by the
+    // variance, with mean and variance of all samples.
+    void write(std::ostream& out) const
+    {
+        if (levels_.empty() || 0 == levels_[0].counts[0]) {
+            return;
+        }
+        const double mean = sum_ / levels_[0].counts[0];
+        const double variance = levels_[0].sums[0] / levels_[0].counts[0] - mean * mean;
+        for (std::size_t k = 0; k < levels_.size(); ++k) {
+            for (std::size_t j = 0 == k ? 0 : points_ / 2; j < points_; ++j) {
+                if (0 == levels_[k].counts[j]) {
+                    continue;
+                }
+                const level_t& level = levels_[k];
+                double covariance = (level.sums[j] - mean * (level.earlier[j] + level.later[j])) / level.counts[j] + mean * mean;
+                out << (static_cast<std::uint64_t>(j) << k) << " " << (variance > 0. ? covariance / variance : 0.) << "\n";
+            }
+        }
+    }
+
+private:
+    struct level_t;
+
+    void check(const level_t& level) const
+    {
+        if (level.values.size() != 2 * points_ || level.sums.size() != points_ || level.earlier.size() != points_ || level.later.size() != points_
+            || level.counts.size() != points_ || level.head >= points_ || level.filled > points_) {
+            throw std::runtime_error("Invalid checkpoint data.");
+        }
+    }
+
+    struct level_t
+    {
+        explicit level_t(std::size_t points)
+            : values(2 * points, 0.)
+            , sums(points, 0.)
+            , earlier(points, 0.)
+            , later(points, 0.)
+            , counts(points, 0)
+            , head(0)
+            , filled(0)
+            , accumulator(0.)
+            , accumulated(0)
+        {
+        }
+
+        std::vector<double> values;
+        std::vector<double> sums; // of the pair products per lag
+        std::vector<double> earlier; // of the earlier pair members
+        std::vector<double> later; // of the later pair members
+        std::vector<std::uint64_t> counts;
+        std::size_t head;
+        std::size_t filled;
+        double accumulator;
+        std::size_t accumulated;
+    };
+
+    std::size_t points_;
+    std::size_t max_levels_;
+    double sum_; // of level 0 samples
+    std::vector<level_t> levels_;
+};
+
+// Which online observers run and what they see.
+struct observer_settings_t
+{
+    std::size_t start_step = 0; // earlier samples are ignored
+    double histogram_bin = 0.; // 0 - no density histogram
+    std::size_t correlator_points = 0; // 0 - no autocorrelation
+    bool moments = false;
+
+    bool enabled() const
+    {
+        return histogram_bin > 0. || correlator_points > 0 || moments;
+    }
+};
+
+// Density observers of one lambda fed with every sample of the repetitions,
+// so the stationary analysis needs no intermediate trajectory files.
+struct density_observers_t
+{
+    explicit density_observers_t(const observer_settings_t& settings)
+        : settings_(settings)
+        , histogram_(histogram_binning_t::linear(0., 1., settings.histogram_bin > 0. ? settings.histogram_bin : 1.))
+        , correlator_(settings.correlator_points)
+    {
+    }
+
+    void begin_repetition()
+    {
+        correlator_.begin_repetition();
+    }
+
+    void add(std::size_t step, double density)
+    {
+        if (step < settings_.start_step) {
+            return;
+        }
+        if (settings_.histogram_bin > 0.) {
+            histogram_.add(density);
+        }
+        if (settings_.correlator_points > 0) {
+            correlator_.add(density);
+        }
+        if (settings_.moments) {
+            moments_.add(density);
+        }
+    }
+
+    void merge(const density_observers_t& other)
+    {
+        histogram_.merge(other.histogram_);
+        correlator_.merge(other.correlator_);
+        moments_.merge(other.moments_);
+    }
+
+    void save(binary_writer_t& out) const
+    {
+        histogram_.save(out);
+        correlator_.save(out);
+        moments_.save(out);
+    }
+
+    void load(binary_reader_t& in)
+    {
+        histogram_.load(in);
+        correlator_.load(in);
+        moments_.load(in);
+    }
+
+    // State that belongs to the running repetition rather than to the sums.
+    void save_repetition(binary_writer_t& out) const
+    {
+        correlator_.save_registers(out);
+    }
+
+    void load_repetition(binary_reader_t& in)
+    {
+        correlator_.load_registers(in);
+    }
+
+    observer_settings_t settings_;
+    histogram_t histogram_;
+    multi_tau_correlator_t correlator_;
+    running_moments_t moments_;
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/dynamic_bitset.hpp>
+
+#include "binary_io.hpp"
+#include "csr_graph.hpp"
+#include "random.hpp"
+
+typedef std::uint64_t replica_mask_t;
+
+// States of up to 64 independent replicas of the model on the same graph
+// (multispin coding): bit b of active_[i] is set if node i is active in
+// replica b. Nodes active in at least one replica are kept in a dense array
+// like in active_set_t, so a node can be drawn uniformly from their union.
+// Per-replica active and ever-active node counts are kept up to date.
+class replica_states_t
+{
+public:
+    static constexpr std::size_t width = 64;
+    static constexpr node_t npos = std::numeric_limits<node_t>::max();
+
+    // Every replica in 'replicas' starts from the same states (passive_[i] == true
+    // means node i is inactive); the other bits stay inactive forever.
+    replica_states_t(const boost::dynamic_bitset<>& states, replica_mask_t replicas)
+        : active_(states.size(), 0)
+        , ever_active_(states.size(), 0)
+        , position_(states.size(), npos)
+        , counts_(width, 0)
+        , ever_counts_(width, 0)
+        , alive_(0)
+    {
+        nodes_.reserve(states.size());
+        for (std::size_t i = 0; i < states.size(); ++i) {
+            if (!states[i]) {
+                activate(static_cast<node_t>(i), replicas);
+            }
+        }
+    }
+
+    // Replicas in which the node is active.
+    replica_mask_t active(node_t node) const
+    {
+        return active_[node];
+    }
+
+    void activate(node_t node, replica_mask_t replicas)
+    {
+        replica_mask_t added = replicas & ~active_[node];
+        if (!added) {
+            return;
+        }
+        if (!active_[node]) {
+            position_[node] = static_cast<node_t>(nodes_.size());
+            nodes_.emplace_back(node);
+        }
+        active_[node] |= added;
+        for (replica_mask_t m = added; m; m &= m - 1) {
+            ++counts_[__builtin_ctzll(m)];
+        }
+        alive_ |= added;
+        replica_mask_t first = added & ~ever_active_[node];
+        ever_active_[node] |= first;
+        for (; first; first &= first - 1) {
+            ++ever_counts_[__builtin_ctzll(first)];
+        }
+    }
+
+    void deactivate(node_t node, replica_mask_t replicas)
+    {
+        replica_mask_t removed = replicas & active_[node];
+        if (!removed) {
+            return;
+        }
+        active_[node] &= ~removed;
+        for (replica_mask_t m = removed; m; m &= m - 1) {
+            std::size_t b = __builtin_ctzll(m);
+            if (0 == --counts_[b]) {
+                alive_ &= ~(replica_mask_t(1) << b);
+            }
+        }
+        if (!active_[node]) {
+            // move the last node of the union into the freed slot
+            node_t pos = position_[node];
+            node_t last = nodes_.back();
+            nodes_[pos] = last;
+            position_[last] = pos;
+            nodes_.pop_back();
+            position_[node] = npos;
+        }
+    }
+
+    // Number of nodes active in at least one replica.
+    std::size_t size() const
+    {
+        return nodes_.size();
+    }
+
+    bool empty() const
+    {
+        return nodes_.empty();
+    }
+
+    std::size_t node_count() const
+    {
+        return active_.size();
+    }
+
+    // Replicas with at least one active node.
+    replica_mask_t alive() const
+    {
+        return alive_;
+    }
+
+    std::size_t count(std::size_t replica) const
+    {
+        return counts_[replica];
+    }
+
+    std::size_t ever_active_count(std::size_t replica) const
+    {
+        return ever_counts_[replica];
+    }
+
+    // The order of the union is part of the state: random() depends on it.
+    void save(binary_writer_t& out) const
+    {
+        out.write(active_);
+        out.write(ever_active_);
+        out.write(nodes_);
+    }
+
+    void load(binary_reader_t& in)
+    {
+        const std::size_t node_count = active_.size();
+        in.read(active_);
+        in.read(ever_active_);
+        in.read(nodes_);
+        if (active_.size() != node_count || ever_active_.size() != node_count) {
+            throw std::runtime_error("Invalid checkpoint data.");
+        }
+        std::fill(position_.begin(), position_.end(), npos);
+        std::fill(counts_.begin(), counts_.end(), 0);
+        std::fill(ever_counts_.begin(), ever_counts_.end(), 0);
+        alive_ = 0;
+        for (std::size_t k = 0; k < nodes_.size(); ++k) {
+            if (nodes_[k] >= node_count || npos != position_[nodes_[k]] || !active_[nodes_[k]]) {
+                throw std::runtime_error("Invalid checkpoint data.");
+            }
+            position_[nodes_[k]] = static_cast<node_t>(k);
+        }
+        for (std::size_t i = 0; i < node_count; ++i) {
+            if (active_[i] && npos == position_[i]) {
+                throw std::runtime_error("Invalid checkpoint data.");
+            }
+            for (replica_mask_t m = active_[i]; m; m &= m - 1) {
+                ++counts_[__builtin_ctzll(m)];
+            }
+            for (replica_mask_t m = ever_active_[i]; m; m &= m - 1) {
+                ++ever_counts_[__builtin_ctzll(m)];
+            }
+            alive_ |= active_[i];
+        }
+    }
+
+    // Uniformly chosen node of the union. The set must not be empty.
+    template <class engine_t>
+    node_t random(engine_t& gen) const
+    {
+        return nodes_[uniform_index(gen, nodes_.size())];
+    }
+
+private:
+    std::vector<replica_mask_t> active_;
+    std::vector<replica_mask_t> ever_active_;
+    std::vector<node_t> nodes_;
+    std::vector<node_t> position_;
+    std::vector<std::size_t> counts_;
+    std::vector<std::size_t> ever_counts_;
+    replica_mask_t alive_;
+};
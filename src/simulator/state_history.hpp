@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "active_set.hpp"
+#include "binary_io.hpp"
+#include "csr_graph.hpp"
+#include "random.hpp"
+
+// Ring buffer of the last active configurations of a repetition, used by the
+// quasi-stationary method: when the repetition falls into the absorbing state,
+// it continues from a configuration drawn uniformly from the history. New
+// snapshots overwrite the oldest one.
+//
+// A snapshot is stored in the smaller of two encodings: the list of active
+// nodes (32 bits per active node) or a bitmap of all nodes (one bit per node),
+// so sparse configurations near the critical point cost little to store. The
+// storage of each slot is reused, so taking snapshots does not allocate once
+// the buffer is warm. A history of capacity 0 never holds a snapshot.
+class state_history_t
+{
+public:
+    explicit state_history_t(std::size_t capacity)
+        : slots_(capacity)
+        , next_(0)
+        , size_(0)
+    {
+    }
+
+    bool empty() const
+    {
+        return 0 == size_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    void push(const active_set_t& active)
+    {
+        if (slots_.empty()) {
+            return;
+        }
+        slot_t& slot = slots_[next_];
+        const std::vector<node_t>& nodes = active.nodes();
+        const std::size_t node_count = active.node_count();
+        slot.bitmap = nodes.size() * 32 > node_count;
+        if (slot.bitmap) {
+            slot.words.assign((node_count + 31) / 32, 0);
+            for (node_t node : nodes) {
+                slot.words[node / 32] |= std::uint32_t(1) << (node % 32);
+            }
+        } else {
+            slot.words.assign(nodes.begin(), nodes.end());
+        }
+        next_ = (next_ + 1) % slots_.size();
+        if (size_ < slots_.size()) {
+            ++size_;
+        }
+    }
+
+    // Activates the nodes of a uniformly chosen snapshot in the empty set.
+    template <class engine_t>
+    void restore(engine_t& gen, active_set_t& active) const
+    {
+        const slot_t& slot = slots_[uniform_index(gen, size_)];
+        if (slot.bitmap) {
+            for (std::size_t w = 0; w < slot.words.size(); ++w) {
+                for (std::uint32_t bits = slot.words[w]; bits; bits &= bits - 1) {
+                    active.activate(static_cast<node_t>(w * 32 + __builtin_ctz(bits)));
+                }
+            }
+        } else {
+            for (std::uint32_t node : slot.words) {
+                active.activate(node);
+            }
+        }
+    }
+
+    void save(binary_writer_t& out) const
+    {
+        out.write(static_cast<std::uint64_t>(next_));
+        out.write(static_cast<std::uint64_t>(size_));
+        for (std::size_t k = 0; k < size_; ++k) {
+            out.write(static_cast<std::uint8_t>(slots_[k].bitmap));
+            out.write(slots_[k].words);
+        }
+    }
+
+    void load(binary_reader_t& in, std::size_t node_count)
+    {
+        std::uint64_t next = 0;
+        std::uint64_t size = 0;
+        in.read(next);
+        in.read(size);
+        if (size > slots_.size() || (size < slots_.size() && next != size) || (!slots_.empty() && next >= slots_.size())) {
+            throw std::runtime_error("Invalid checkpoint data.");
+        }
+        next_ = next;
+        size_ = size;
+        for (std::size_t k = 0; k < size_; ++k) {
+            std::uint8_t bitmap = 0;
+            in.read(bitmap);
+            in.read(slots_[k].words);
+            slots_[k].bitmap = 0 != bitmap;
+            const bool valid = slots_[k].bitmap ? slots_[k].words.size() == (node_count + 31) / 32 : slots_[k].words.size() <= node_count;
+            if (!valid) {
+                throw std::runtime_error("Invalid checkpoint data.");
+            }
+            if (slots_[k].bitmap && 0 != node_count % 32 && 0 != (slots_[k].words.back() >> (node_count % 32))) {
+                throw std::runtime_error("Invalid checkpoint data.");
+            }
+            for (std::size_t w = 0; !slots_[k].bitmap && w < slots_[k].words.size(); ++w) {
+                if (slots_[k].words[w] >= node_count) {
+                    throw std::runtime_error("Invalid checkpoint data.");
+                }
+            }
+        }
+    }
+
+private:
+    struct slot_t
+    {
+        bool bitmap = false;
+        std::vector<std::uint32_t> words; // node ids or bitmap words
+    };
+
+    std::vector<slot_t> slots_;
+    std::size_t next_; // slot of the next snapshot
+    std::size_t size_;
+};
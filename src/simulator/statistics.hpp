@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "binary_io.hpp"
+#include "node_activity.hpp"
+#include "observers.hpp"
+#include "trajectory_accumulator.hpp"
+
+// Absorbing-state observables summed over repetitions.
+struct absorption_statistics_t
+{
+    std::size_t repetitions_ = 0;
+    std::size_t survived_ = 0;
+    double survival_time_sum_ = 0.; // absorbed repetitions only
+    double distinct_activated_sum_ = 0.;
+
+    void add(bool survived, double survival_time, std::size_t distinct_activated)
+    {
+        ++repetitions_;
+        if (survived) {
+            ++survived_;
+        } else {
+            survival_time_sum_ += survival_time;
+        }
+        distinct_activated_sum_ += distinct_activated;
+    }
+
+    void merge(const absorption_statistics_t& other)
+    {
+        repetitions_ += other.repetitions_;
+        survived_ += other.survived_;
+        survival_time_sum_ += other.survival_time_sum_;
+        distinct_activated_sum_ += other.distinct_activated_sum_;
+    }
+
+    void save(binary_writer_t& out) const
+    {
+        out.write(static_cast<std::uint64_t>(repetitions_));
+        out.write(static_cast<std::uint64_t>(survived_));
+        out.write(survival_time_sum_);
+        out.write(distinct_activated_sum_);
+    }
+
+    void load(binary_reader_t& in)
+    {
+        std::uint64_t repetitions = 0;
+        std::uint64_t survived = 0;
+        in.read(repetitions);
+        in.read(survived);
+        in.read(survival_time_sum_);
+        in.read(distinct_activated_sum_);
+        repetitions_ = repetitions;
+        survived_ = survived;
+    }
+
+    double survival_probability() const
+    {
+        return repetitions_ ? survived_ / static_cast<double>(repetitions_) : 0.;
+    }
+
+    // Mean time to absorption of the repetitions that did not survive.
+    double mean_survival_time() const
+    {
+        return repetitions_ > survived_ ? survival_time_sum_ / (repetitions_ - survived_) : 0.;
+    }
+
+    double mean_distinct_activated() const
+    {
+        return repetitions_ ? distinct_activated_sum_ / repetitions_ : 0.;
+    }
+};
+
+// Quasi-stationary averages: time integrals of the density and its square after
+// the relaxation time, and the number of absorptions in that time, each of which
+// sent the repetition back into its state history. The running repetition is
+// kept apart and folded into the totals when it ends, which also records its
+// time averaged density for the error between repetitions.
+struct quasi_stationary_statistics_t
+{
+    std::size_t repetitions_ = 0;
+    double time_ = 0.;
+    double density_time_ = 0.;
+    double square_time_ = 0.;
+    std::uint64_t absorptions_ = 0;
+    double mean_sum_ = 0.; // of the repetitions' time averaged densities
+    double mean_square_sum_ = 0.;
+
+    double repetition_time_ = 0.;
+    double repetition_density_time_ = 0.;
+    double repetition_square_time_ = 0.;
+    std::uint64_t repetition_absorptions_ = 0;
+
+    // Density held for duration dt.
+    void add(double dt, double density)
+    {
+        repetition_time_ += dt;
+        repetition_density_time_ += density * dt;
+        repetition_square_time_ += density * density * dt;
+    }
+
+    void absorbed()
+    {
+        ++repetition_absorptions_;
+    }
+
+    void end_repetition()
+    {
+        if (repetition_time_ > 0.) {
+            const double mean = repetition_density_time_ / repetition_time_;
+            ++repetitions_;
+            mean_sum_ += mean;
+            mean_square_sum_ += mean * mean;
+            time_ += repetition_time_;
+            density_time_ += repetition_density_time_;
+            square_time_ += repetition_square_time_;
+            absorptions_ += repetition_absorptions_;
+        }
+        repetition_time_ = 0.;
+        repetition_density_time_ = 0.;
+        repetition_square_time_ = 0.;
+        repetition_absorptions_ = 0;
+    }
+
+    void merge(const quasi_stationary_statistics_t& other)
+    {
+        repetitions_ += other.repetitions_;
+        time_ += other.time_;
+        density_time_ += other.density_time_;
+        square_time_ += other.square_time_;
+        absorptions_ += other.absorptions_;
+        mean_sum_ += other.mean_sum_;
+        mean_square_sum_ += other.mean_square_sum_;
+    }
+
+    void save(binary_writer_t& out) const
+    {
+        out.write(static_cast<std::uint64_t>(repetitions_));
+        out.write(time_);
+        out.write(density_time_);
+        out.write(square_time_);
+        out.write(absorptions_);
+        out.write(mean_sum_);
+        out.write(mean_square_sum_);
+    }
+
+    void load(binary_reader_t& in)
+    {
+        std::uint64_t repetitions = 0;
+        in.read(repetitions);
+        in.read(time_);
+        in.read(density_time_);
+        in.read(square_time_);
+        in.read(absorptions_);
+        in.read(mean_sum_);
+        in.read(mean_square_sum_);
+        repetitions_ = repetitions;
+    }
+
+    void save_repetition(binary_writer_t& out) const
+    {
+        out.write(repetition_time_);
+        out.write(repetition_density_time_);
+        out.write(repetition_square_time_);
+        out.write(repetition_absorptions_);
+    }
+
+    void load_repetition(binary_reader_t& in)
+    {
+        in.read(repetition_time_);
+        in.read(repetition_density_time_);
+        in.read(repetition_square_time_);
+        in.read(repetition_absorptions_);
+    }
+
+    // Quasi-stationary density, averaged over the time of all repetitions.
+    double density() const
+    {
+        return time_ > 0. ? density_time_ / time_ : 0.;
+    }
+
+    // Standard error of density() from the spread between repetitions.
+    double density_error() const
+    {
+        if (repetitions_ < 2) {
+            return 0.;
+        }
+        const double n = static_cast<double>(repetitions_);
+        const double mean = mean_sum_ / n;
+        const double variance = std::max(0., mean_square_sum_ / n - mean * mean) * n / (n - 1.);
+        return std::sqrt(variance / n);
+    }
+
+    // <rho^2> / <rho>^2, which takes a universal value at the critical point.
+    double moment_ratio() const
+    {
+        const double rho = density();
+        return rho > 0. ? square_time_ / time_ / (rho * rho) : 0.;
+    }
+
+    // Mean time between absorptions of the quasi-stationary state.
+    double lifetime() const
+    {
+        return absorptions_ ? time_ / absorptions_ : std::numeric_limits<double>::infinity();
+    }
+};
+
+// Everything collected for one lambda: the averaged density with its variance
+// between repetitions, the fraction of still active repetitions per time bin
+// (survival probability P(t)) and the
+// absorbing-state summary, the quasi-stationary averages, plus the optional online observers of the raw
+// density samples and per-node activity (enabled by a nonzero activity_node_count). Each task fills its own copy, which is merged into the
+// copy of its thread when the task is done; threads merge theirs once.
+struct lambda_statistics_t
+{
+    lambda_statistics_t(const time_binning_t& binning, const observer_settings_t& observer_settings, std::size_t activity_node_count = 0)
+        : density_(binning, true)
+        , survival_(binning)
+        , observers_enabled_(observer_settings.enabled())
+        , observers_(observer_settings)
+        , node_activity_(activity_node_count)
+    {
+    }
+
+    // group_size > 1 starts a group of correlated repetitions (multispin block) added as one.
+    void begin_repetition(std::size_t group_size = 1)
+    {
+        density_.begin_repetition(group_size);
+        survival_.begin_repetition();
+        observers_.begin_repetition();
+    }
+
+    void end_repetition()
+    {
+        density_.end_repetition();
+        quasi_stationary_.end_repetition();
+    }
+
+    // Records a sample of a repetition that is still active.
+    void add(std::size_t time, double density)
+    {
+        density_.add(time, density);
+        survival_.add(time, 1.);
+        if (observers_enabled_) {
+            observers_.add(time, density);
+        }
+    }
+
+    void merge(const lambda_statistics_t& other)
+    {
+        density_.merge(other.density_);
+        survival_.merge(other.survival_);
+        absorption_.merge(other.absorption_);
+        quasi_stationary_.merge(other.quasi_stationary_);
+        observers_.merge(other.observers_);
+        node_activity_.merge(other.node_activity_);
+    }
+
+    // Partial sums for checkpoints.
+    void save(binary_writer_t& out) const
+    {
+        density_.save(out);
+        survival_.save(out);
+        absorption_.save(out);
+        quasi_stationary_.save(out);
+        observers_.save(out);
+        node_activity_.save(out);
+    }
+
+    void load(binary_reader_t& in)
+    {
+        density_.load(in);
+        survival_.load(in);
+        absorption_.load(in);
+        quasi_stationary_.load(in);
+        observers_.load(in);
+        node_activity_.load(in);
+    }
+
+    // State of the running repetition kept here (unfinished density bin, quasi-stationary
+    // sums, observer registers, node activation times).
+    void save_repetition(binary_writer_t& out) const
+    {
+        density_.save_repetition(out);
+        quasi_stationary_.save_repetition(out);
+        observers_.save_repetition(out);
+        node_activity_.save_repetition(out);
+    }
+
+    void load_repetition(binary_reader_t& in)
+    {
+        begin_repetition();
+        density_.load_repetition(in);
+        quasi_stationary_.load_repetition(in);
+        observers_.load_repetition(in);
+        node_activity_.load_repetition(in);
+    }
+
+    // Mean density of the repetitions still active in the bin.
+    double surviving_density(std::size_t bin, std::size_t repetition_count) const
+    {
+        double survival = survival_.mean(bin, repetition_count);
+        return survival > 0. ? density_.mean(bin, repetition_count) / survival : 0.;
+    }
+
+    trajectory_accumulator_t density_;
+    trajectory_accumulator_t survival_;
+    absorption_statistics_t absorption_;
+    quasi_stationary_statistics_t quasi_stationary_;
+    bool observers_enabled_;
+    density_observers_t observers_;
+    node_activity_t node_activity_;
+};
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "random.hpp"
+
+// Hot-path telemetry of the simulator: step rate per thread, the share of
+// time spent sampling the next event, propagating it and recording output,
+// the active set size and the random engine calls per step. It is compiled
+// in with -DSIMULATOR_TELEMETRY; otherwise telemetry_probe_t is empty and the
+// step loops contain no telemetry code at all.
+
+enum telemetry_phase_t
+{
+    telemetry_sampling,
+    telemetry_propagation,
+    telemetry_output,
+    telemetry_phase_count
+};
+
+#ifdef SIMULATOR_TELEMETRY
+
+constexpr bool telemetry_compiled = true;
+
+// Totals of one worker thread, published by its probes and read by the reporter.
+struct alignas(64) telemetry_counters_t
+{
+    std::atomic<std::uint64_t> steps{ 0 };
+    std::atomic<std::uint64_t> active_sum{ 0 };
+    std::atomic<std::uint64_t> active{ 0 }; // at the last publication
+    std::atomic<std::uint64_t> random_draws{ 0 };
+    std::atomic<std::uint64_t> phase_nanoseconds[telemetry_phase_count] = {};
+};
+
+// Counters of the calling thread; null outside the simulation threads.
+inline thread_local telemetry_counters_t* telemetry_thread_counters = nullptr;
+inline thread_local std::uint64_t telemetry_random_draws = 0;
+
+// Random engine counting its calls in telemetry_random_draws.
+template <class engine_t>
+class counting_engine_t : public engine_t
+{
+public:
+    explicit counting_engine_t(const engine_t& gen)
+        : engine_t(gen)
+    {
+    }
+
+    typename engine_t::result_type operator()()
+    {
+        ++telemetry_random_draws;
+        return engine_t::operator()();
+    }
+};
+
+template <class engine_t>
+struct stream_factory_t<counting_engine_t<engine_t> >
+{
+    static counting_engine_t<engine_t> make(std::uint64_t seed, std::uint64_t stream)
+    {
+        return counting_engine_t<engine_t>(stream_factory_t<engine_t>::make(seed, stream));
+    }
+};
+
+// Per-repetition recorder used by the step loops. Counts are kept locally and
+// published to the thread's counters every few thousand steps; phase times
+// are only measured on every 16th step, which keeps clock reads off most steps.
+class telemetry_probe_t
+{
+public:
+    telemetry_probe_t()
+        : counters_(telemetry_thread_counters)
+        , random_draws_(telemetry_random_draws)
+    {
+    }
+
+    ~telemetry_probe_t()
+    {
+        publish();
+    }
+
+    telemetry_probe_t(const telemetry_probe_t&) = delete;
+    telemetry_probe_t& operator=(const telemetry_probe_t&) = delete;
+
+    // Starts a step with the given number of active nodes.
+    void step(std::size_t active)
+    {
+        ++steps_;
+        active_sum_ += active;
+        active_ = active;
+        if (0 == (steps_ & publish_mask)) {
+            publish();
+        }
+        timed_ = 0 == (steps_ & timing_mask);
+        if (timed_) {
+            last_ = clock_t::now();
+        }
+    }
+
+    // Books the time since the previous mark of the step to the phase.
+    void mark(telemetry_phase_t phase)
+    {
+        if (timed_) {
+            clock_t::time_point now = clock_t::now();
+            phase_nanoseconds_[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count();
+            last_ = now;
+        }
+    }
+
+private:
+    typedef std::chrono::steady_clock clock_t;
+    static constexpr std::uint64_t timing_mask = 15;
+    static constexpr std::uint64_t publish_mask = 4095;
+
+    void publish()
+    {
+        if (!counters_) {
+            return;
+        }
+        const std::memory_order order = std::memory_order_relaxed;
+        counters_->steps.fetch_add(steps_ - published_steps_, order);
+        counters_->active_sum.fetch_add(active_sum_, order);
+        counters_->active.store(active_, order);
+        counters_->random_draws.fetch_add(telemetry_random_draws - random_draws_, order);
+        for (std::size_t k = 0; k < telemetry_phase_count; ++k) {
+            counters_->phase_nanoseconds[k].fetch_add(phase_nanoseconds_[k], order);
+            phase_nanoseconds_[k] = 0;
+        }
+        published_steps_ = steps_;
+        active_sum_ = 0;
+        random_draws_ = telemetry_random_draws;
+    }
+
+    telemetry_counters_t* counters_;
+    std::uint64_t steps_ = 0;
+    std::uint64_t published_steps_ = 0;
+    std::uint64_t active_sum_ = 0;
+    std::uint64_t active_ = 0;
+    std::uint64_t random_draws_;
+    std::uint64_t phase_nanoseconds_[telemetry_phase_count] = {};
+    bool timed_ = false;
+    clock_t::time_point last_;
+};
+
+// Background thread that aggregates the counters of all worker threads and
+// writes one report per interval, and a final one when it is destroyed, to
+// stderr as text or to a file as JSON lines.
+class telemetry_reporter_t
+{
+public:
+    telemetry_reporter_t(std::size_t thread_count, double interval_seconds, const std::string& path)
+        : counters_(thread_count)
+        , previous_(thread_count)
+        , interval_(interval_seconds)
+        , start_(clock_t::now())
+        , last_report_(start_)
+        , stopping_(false)
+    {
+        if (!path.empty()) {
+            file_.reset(new std::ofstream(path));
+            if (!file_->is_open()) {
+                throw std::runtime_error("Cannot create telemetry file.");
+            }
+        }
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~telemetry_reporter_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        stopped_.notify_one();
+        thread_.join();
+        report();
+    }
+
+    telemetry_reporter_t(const telemetry_reporter_t&) = delete;
+    telemetry_reporter_t& operator=(const telemetry_reporter_t&) = delete;
+
+    // Makes the probes created on the calling thread publish to the counters of 'thread'.
+    void attach(std::size_t thread)
+    {
+        telemetry_thread_counters = &counters_[thread];
+    }
+
+private:
+    typedef std::chrono::steady_clock clock_t;
+
+    struct snapshot_t
+    {
+        std::uint64_t steps = 0;
+        std::uint64_t active_sum = 0;
+        std::uint64_t random_draws = 0;
+        std::uint64_t phase_nanoseconds[telemetry_phase_count] = {};
+    };
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopped_.wait_for(lock, interval_, [this] { return stopping_; })) {
+            report();
+        }
+    }
+
+    // Rates over the time since the previous report.
+    void report()
+    {
+        const clock_t::time_point now = clock_t::now();
+        const double elapsed = std::chrono::duration<double>(now - last_report_).count();
+        last_report_ = now;
+        snapshot_t total;
+        std::vector<double> rates(counters_.size());
+        std::vector<std::uint64_t> active(counters_.size());
+        for (std::size_t t = 0; t < counters_.size(); ++t) {
+            const std::memory_order order = std::memory_order_relaxed;
+            snapshot_t current;
+            current.steps = counters_[t].steps.load(order);
+            current.active_sum = counters_[t].active_sum.load(order);
+            current.random_draws = counters_[t].random_draws.load(order);
+            for (std::size_t k = 0; k < telemetry_phase_count; ++k) {
+                current.phase_nanoseconds[k] = counters_[t].phase_nanoseconds[k].load(order);
+            }
+            active[t] = counters_[t].active.load(order);
+
+            const snapshot_t& previous = previous_[t];
+            rates[t] = elapsed > 0. ? (current.steps - previous.steps) / elapsed : 0.;
+            total.steps += current.steps - previous.steps;
+            total.active_sum += current.active_sum - previous.active_sum;
+            total.random_draws += current.random_draws - previous.random_draws;
+            for (std::size_t k = 0; k < telemetry_phase_count; ++k) {
+                total.phase_nanoseconds[k] += current.phase_nanoseconds[k] - previous.phase_nanoseconds[k];
+            }
+            previous_[t] = current;
+        }
+
+        double phase_total = 0.;
+        for (std::size_t k = 0; k < telemetry_phase_count; ++k) {
+            phase_total += total.phase_nanoseconds[k];
+        }
+        double shares[telemetry_phase_count] = {};
+        for (std::size_t k = 0; k < telemetry_phase_count; ++k) {
+            shares[k] = phase_total > 0. ? total.phase_nanoseconds[k] / phase_total : 0.;
+        }
+        const double steps = total.steps;
+        const double mean_active = steps > 0. ? total.active_sum / steps : 0.;
+        const double draws_per_step = steps > 0. ? total.random_draws / steps : 0.;
+        const double time = std::chrono::duration<double>(now - start_).count();
+
+        std::ostringstream line;
+        if (file_) {
+            line << "{\"time\": " << time << ", \"steps_per_second\": " << (elapsed > 0. ? steps / elapsed : 0.) << ", \"thread_steps_per_second\": [";
+            for (std::size_t t = 0; t < rates.size(); ++t) {
+                line << (t ? ", " : "") << rates[t];
+            }
+            line << "], \"active\": [";
+            for (std::size_t t = 0; t < active.size(); ++t) {
+                line << (t ? ", " : "") << active[t];
+            }
+            line << "], \"mean_active\": " << mean_active << ", \"sampling\": " << shares[telemetry_sampling] << ", \"propagation\": " << shares[telemetry_propagation]
+                 << ", \"output\": " << shares[telemetry_output] << ", \"random_draws_per_step\": " << draws_per_step << "}\n";
+            *file_ << line.str() << std::flush;
+        } else {
+            line << "telemetry t = " << time << " s; steps/s = " << (elapsed > 0. ? steps / elapsed : 0.) << " [";
+            for (std::size_t t = 0; t < rates.size(); ++t) {
+                line << (t ? " " : "") << rates[t];
+            }
+            line << "]; sampling/propagation/output = " << shares[telemetry_sampling] << "/" << shares[telemetry_propagation] << "/" << shares[telemetry_output]
+                 << "; mean active = " << mean_active << "; draws/step = " << draws_per_step << "\n";
+            std::cerr << line.str();
+        }
+    }
+
+    std::vector<telemetry_counters_t> counters_;
+    std::vector<snapshot_t> previous_; // only touched by report()
+    const std::chrono::duration<double> interval_;
+    const clock_t::time_point start_;
+    clock_t::time_point last_report_;
+    std::unique_ptr<std::ofstream> file_;
+    bool stopping_;
+    std::mutex mutex_;
+    std::condition_variable stopped_;
+    std::thread thread_;
+};
+
+#else
+
+constexpr bool telemetry_compiled = false;
+
+class telemetry_probe_t
+{
+public:
+    void step(std::size_t)
+    {
+    }
+
+    void mark(telemetry_phase_t)
+    {
+    }
+};
+
+class telemetry_reporter_t
+{
+public:
+    void attach(std::size_t)
+    {
+    }
+};
+
+#endif
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "binary_io.hpp"
+
+// Time binning of the averaged trajectory: either one bin per sample point or
+// log-spaced bins of whole steps with a fixed number of bins per decade.
+class time_binning_t
+{
+public:
+    static time_binning_t dense(std::size_t point_count)
+    {
+        time_binning_t binning;
+        binning.point_count_ = point_count;
+        return binning;
+    }
+
+    // Bin 0 holds step 0, the following bins start at ceil(10^(k / bins_per_decade)).
+    static time_binning_t logarithmic(std::size_t step_count, std::size_t bins_per_decade)
+    {
+        time_binning_t binning;
+        binning.point_count_ = step_count;
+        binning.edges_.emplace_back(0);
+        for (std::size_t k = 0; binning.edges_.back() < step_count; ++k) {
+            std::size_t edge = static_cast<std::size_t>(std::ceil(std::pow(10.0, k / static_cast<double>(bins_per_decade))));
+            edge = std::min(edge, step_count);
+            if (edge > binning.edges_.back()) {
+                binning.edges_.emplace_back(edge);
+            }
+        }
+        return binning;
+    }
+
+    bool is_dense() const
+    {
+        return edges_.empty();
+    }
+
+    std::size_t size() const
+    {
+        return is_dense() ? point_count_ : edges_.size() - 1;
+    }
+
+    // First step of the bin.
+    std::size_t first(std::size_t bin) const
+    {
+        return is_dense() ? bin : edges_[bin];
+    }
+
+    // Number of steps in the bin.
+    std::size_t width(std::size_t bin) const
+    {
+        return is_dense() ? 1 : edges_[bin + 1] - edges_[bin];
+    }
+
+    // Representative time of the bin: the mean step it covers.
+    double center(std::size_t bin) const
+    {
+        return first(bin) + (width(bin) - 1) / 2.0;
+    }
+
+private:
+    time_binning_t()
+        : point_count_(0)
+    {
+    }
+
+    std::size_t point_count_;
+    std::vector<std::size_t> edges_;
+};
+
+// Compensated (Kahan) sums of the density over the bins of a time binning.
+// Each thread owns one accumulator and the per-thread results are merged once
+// at the end, so the step loop never synchronizes. Storage grows only up to
+// the last bin actually reached (std::vector amortizes the growth), so absorbed
+// runs stay cheap and size() tells how far the repetitions got.
+//
+// With squares enabled, the accumulator also sums the square of every
+// repetition's mean over each bin, which gives the variance between
+// repetitions. The values of a bin are summed per repetition first, so an
+// accumulator with squares must only see one repetition at a time. Correlated
+// repetitions that run together as one group (the replicas of a multispin
+// block) count as one repetition here: the square is taken of the group's sum,
+// and the error is the one of a weighted mean of the group means, each group
+// weighted by its size, so a short last group is accounted for exactly.
+class trajectory_accumulator_t
+{
+public:
+    explicit trajectory_accumulator_t(const time_binning_t& binning, bool squares = false)
+        : binning_(&binning)
+        , squares_(squares)
+        , bin_(0)
+        , pending_(0.)
+        , group_size_(1)
+        , group_count_(0)
+        , group_square_sum_(0.)
+    {
+    }
+
+    // Resets the bin cursor for a repetition, or a group of group_size correlated
+    // repetitions added as one; steps within a repetition must not decrease.
+    void begin_repetition(std::size_t group_size = 1)
+    {
+        flush();
+        bin_ = 0;
+        group_size_ = group_size;
+    }
+
+    // Completes the squares of the running repetition.
+    void end_repetition()
+    {
+        flush();
+        if (squares_) {
+            ++group_count_;
+            group_square_sum_ += static_cast<double>(group_size_) * group_size_;
+        }
+    }
+
+    void add(std::size_t step, double value)
+    {
+        if (binning_->is_dense()) {
+            if (step != bin_) {
+                flush();
+                bin_ = step;
+            }
+        } else {
+            while (step >= binning_->first(bin_) + binning_->width(bin_)) {
+                flush();
+                ++bin_;
+            }
+        }
+        pending_ += value;
+        add_to_bin(bin_, value);
+    }
+
+    void merge(const trajectory_accumulator_t& other)
+    {
+        for (std::size_t bin = 0; bin < other.sum_.size(); ++bin) {
+            add_to_bin(bin, other.sum_[bin]);
+            add_to_bin(bin, -other.compensation_[bin]);
+        }
+        for (std::size_t bin = 0; bin < other.square_sum_.size(); ++bin) {
+            add_square(bin, other.square_sum_[bin], other.weighted_sum_[bin]);
+        }
+        group_count_ += other.group_count_;
+        group_square_sum_ += other.group_square_sum_;
+    }
+
+    // Partial sums for checkpoints; the binning is not stored.
+    void save(binary_writer_t& out) const
+    {
+        out.write(sum_);
+        out.write(compensation_);
+        out.write(square_sum_);
+        out.write(weighted_sum_);
+        out.write(static_cast<std::uint64_t>(group_count_));
+        out.write(group_square_sum_);
+    }
+
+    void load(binary_reader_t& in)
+    {
+        in.read(sum_);
+        in.read(compensation_);
+        in.read(square_sum_);
+        in.read(weighted_sum_);
+        std::uint64_t group_count = 0;
+        in.read(group_count);
+        in.read(group_square_sum_);
+        if (sum_.size() != compensation_.size() || sum_.size() > binning_->size() || square_sum_.size() > binning_->size() || weighted_sum_.size() != square_sum_.size()) {
+            throw std::runtime_error("Invalid checkpoint data.");
+        }
+        group_count_ = group_count;
+        bin_ = 0;
+        pending_ = 0.;
+    }
+
+    // Bin cursor, unfinished bin and group size of the running repetition.
+    void save_repetition(binary_writer_t& out) const
+    {
+        out.write(static_cast<std::uint64_t>(bin_));
+        out.write(pending_);
+        out.write(static_cast<std::uint64_t>(group_size_));
+    }
+
+    void load_repetition(binary_reader_t& in)
+    {
+        std::uint64_t bin = 0;
+        std::uint64_t group_size = 0;
+        in.read(bin);
+        in.read(pending_);
+        in.read(group_size);
+        if (bin >= std::max<std::size_t>(binning_->size(), 1) || 0 == group_size) {
+            throw std::runtime_error("Invalid checkpoint data.");
+        }
+        bin_ = bin;
+        group_size_ = group_size;
+    }
+
+    // Number of bins up to the last one reached by a repetition.
+    std::size_t size() const
+    {
+        return sum_.size();
+    }
+
+    // Average over repetitions of the mean density in the bin.
+    double mean(std::size_t bin, std::size_t repetition_count) const
+    {
+        return sum(bin) / (static_cast<double>(binning_->width(bin)) * repetition_count);
+    }
+
+    // Sum over repetitions of the density in the bin.
+    double sum(std::size_t bin) const
+    {
+        return sum_[bin] - compensation_[bin];
+    }
+
+    // Standard error of mean() from the variance between the repetitions, or groups of
+    // repetitions, that were added; needs squares. With groups of sizes g_k and means m_k,
+    // it is that of the ratio estimator sum(g_k m_k) / sum(g_k):
+    // B / (B - 1) * sum(g_k^2 (m_k - m)^2) / N^2 for B groups of N repetitions in all.
+    double standard_error(std::size_t bin, std::size_t repetition_count) const
+    {
+        if (group_count_ < 2 || 0 == repetition_count) {
+            return 0.;
+        }
+        const double b = static_cast<double>(group_count_);
+        const double n = static_cast<double>(repetition_count);
+        const double width = static_cast<double>(binning_->width(bin));
+        const double m = mean(bin, repetition_count);
+        const double square_sum = bin < square_sum_.size() ? square_sum_[bin] / (width * width) : 0.;
+        const double weighted_sum = bin < weighted_sum_.size() ? weighted_sum_[bin] / width : 0.;
+        const double deviation_sum = std::max(0., square_sum - 2. * m * weighted_sum + m * m * group_square_sum_);
+        return std::sqrt(b / (b - 1.) * deviation_sum) / n;
+    }
+
+private:
+    void flush()
+    {
+        if (squares_ && 0. != pending_) {
+            add_square(bin_, pending_ * pending_, pending_ * group_size_);
+        }
+        pending_ = 0.;
+    }
+
+    void add_square(std::size_t bin, double square, double weighted)
+    {
+        if (bin >= square_sum_.size()) {
+            square_sum_.resize(bin + 1, 0.);
+            weighted_sum_.resize(bin + 1, 0.);
+        }
+        square_sum_[bin] += square;
+        weighted_sum_[bin] += weighted;
+    }
+
+    void add_to_bin(std::size_t bin, double value)
+    {
+        if (bin >= sum_.size()) {
+            sum_.resize(bin + 1, 0.);
+            compensation_.resize(bin + 1, 0.);
+        }
+        double y = value - compensation_[bin];
+        double t = sum_[bin] + y;
+        compensation_[bin] = (t - sum_[bin]) - y;
+        sum_[bin] = t;
+    }
+
+    const time_binning_t* binning_;
+    bool squares_;
+    std::size_t bin_;
+    double pending_; // sum of the running repetition in bin_
+    std::size_t group_size_; // repetitions of the running group
+    std::size_t group_count_; // completed groups (repetitions) with squares
+    double group_square_sum_; // sum of the squared group sizes
+    std::vector<double> sum_;
+    std::vector<double> compensation_;
+    std::vector<double> square_sum_; // sum of the squared group sums
+    std::vector<double> weighted_sum_; // sum of group size times group sum
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "async_writer.hpp"
+#include "trajectory_format.hpp"
+
+// Per-repetition binary trajectory output. Records are encoded into an
+// in-memory chunk; full chunks are handed to the shared async_writer_t, so
+// the simulation thread never touches the disk.
+class trajectory_writer_t
+{
+public:
+    trajectory_writer_t(async_writer_t& writer, const std::string& path, const trajectory_header_t& header, std::size_t chunk_size = 1 << 20)
+        : writer_(writer)
+        , file_(std::make_shared<std::ofstream>(path, std::ios::binary))
+        , chunk_size_(chunk_size)
+        , previous_count_(0)
+    {
+        chunk_.reserve(chunk_size_ + 32);
+        const char* bytes = reinterpret_cast<const char*>(&header);
+        chunk_.insert(chunk_.end(), bytes, bytes + sizeof(header));
+    }
+
+    trajectory_writer_t(const trajectory_writer_t&) = delete;
+    trajectory_writer_t& operator=(const trajectory_writer_t&) = delete;
+
+    ~trajectory_writer_t()
+    {
+        close();
+    }
+
+    bool is_open() const
+    {
+        return file_ && file_->is_open();
+    }
+
+    // Record of a discrete trajectory; the time is the record index.
+    void append(std::uint64_t active_count)
+    {
+        append_varint(chunk_, static_cast<std::int64_t>(active_count - previous_count_));
+        previous_count_ = active_count;
+        if (chunk_.size() >= chunk_size_) {
+            submit();
+        }
+    }
+
+    // Record of a continuous time trajectory.
+    void append(double time, std::uint64_t active_count)
+    {
+        const char* bytes = reinterpret_cast<const char*>(&time);
+        chunk_.insert(chunk_.end(), bytes, bytes + sizeof(time));
+        append(active_count);
+    }
+
+    // Hands over the last partial chunk and queues closing of the file.
+    void close()
+    {
+        if (!file_) {
+            return;
+        }
+        if (!chunk_.empty()) {
+            submit();
+        }
+        writer_.close(file_);
+        file_.reset();
+    }
+
+private:
+    void submit()
+    {
+        chunk_ = writer_.write(file_, std::move(chunk_));
+        chunk_.reserve(chunk_size_ + 32);
+    }
+
+    async_writer_t& writer_;
+    async_writer_t::file_t file_;
+    std::size_t chunk_size_;
+    std::uint64_t previous_count_;
+    async_writer_t::buffer_t chunk_;
+};
@@ -0,0 +1,79 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#include "trajectory_format.hpp"
+
+namespace po = boost::program_options;
+
+int main(int argc, char **argv)
+{
+	std::string input_file_name;
+	std::string output_file_name;
+	bool print_header = false;
+	po::options_description desc("Program options");
+	desc.add_options()("help", "Produce help message")(
+		"input", po::value<std::string>(&input_file_name)->required(), "Binary trajectory file written by the simulator.")(
+		"output", po::value<std::string>(&output_file_name), "Output text file with 'time density' lines. Defaults to the input name with a .txt extension.")(
+		"header", po::value<bool>(&print_header)->default_value(false), "Print the run parameters stored in the file header.");
+
+	po::variables_map vm;
+	try
+	{
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+	}
+	catch (po::error &e)
+	{
+		std::cerr << "\nError parsing command line: " << e.what() << std::endl
+					 << std::endl;
+		std::cerr << desc << std::endl;
+		return -1;
+	}
+
+	if (vm.count("help"))
+	{
+		std::cout << desc << std::endl;
+		return 1;
+	}
+
+	if (output_file_name.empty())
+	{
+		output_file_name = input_file_name.substr(0, input_file_name.rfind('.')) + ".txt";
+	}
+
+	try
+	{
+		trajectory_reader_t reader(input_file_name);
+		const trajectory_header_t& header = reader.header();
+		if (print_header)
+		{
+			std::cout << "N = " << header.node_count << "; lambda = " << header.lambda << "; mu = " << header.mu
+					  << "; model = " << std::string(header.model, strnlen(header.model, sizeof(header.model)))
+					  << "; seed = " << header.seed << "; repetition = " << header.repetition << std::endl;
+		}
+
+		std::ofstream out(output_file_name);
+		if (!out.is_open())
+		{
+			std::cerr << "Invalid output file." << std::endl;
+			return -1;
+		}
+		const long double N = header.node_count;
+		double time = 0.;
+		std::uint64_t active_count = 0;
+		while (reader.next(time, active_count))
+		{
+			out << time << " " << active_count / N << "\n";
+		}
+		out.close();
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+	return 0;
+}